@@ -18,6 +18,7 @@
 
 #include <tchar.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #if defined( min )
@@ -54,6 +55,7 @@ namespace MyCpp
 	typedef std::vector< char_t > vchar_t;
 
 	typedef std::basic_string< char_t > string_t;
+	typedef std::basic_string_view< char_t > string_view_t;
 
 	class Null
 	{
@@ -107,14 +109,14 @@ namespace MyCpp
 		return N;
 	}
 
-	template < typename CharT >
-	inline CharT* cstr_t( std::vector< CharT >& v )
+	template < typename CharT, typename Allocator >
+	inline CharT* cstr_t( std::vector< CharT, Allocator >& v )
 	{
 		return v.data();
 	}
 
-	template < typename CharT >
-	inline const CharT* cstr_t( const std::vector< CharT >& v )
+	template < typename CharT, typename Allocator >
+	inline const CharT* cstr_t( const std::vector< CharT, Allocator >& v )
 	{
 		return v.data();
 	}
@@ -128,6 +130,7 @@ using MyCpp::dword;
 using MyCpp::longlong;
 using MyCpp::qword;
 using MyCpp::string_t;
+using MyCpp::string_view_t;
 using MyCpp::uchar;
 using MyCpp::uint;
 using MyCpp::ulonglong;
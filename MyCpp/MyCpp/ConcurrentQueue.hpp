@@ -0,0 +1,247 @@
+#pragma once
+
+#ifndef __MYCPP_CONCURRENTQUEUE_HPP__
+#define __MYCPP_CONCURRENTQUEUE_HPP__
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include "MyCpp/Base.hpp"
+
+namespace MyCpp
+{
+	namespace details
+	{
+		constexpr std::size_t CACHE_LINE_SIZE = 64;
+	}
+
+	// A bounded lock-free queue after Dmitry Vyukov's MPMC ring.
+	// Every slot carries a sequence number that tells whether it is free or full for the current lap,
+	// so producers and consumers meet only on the slot they use, never on a shared lock.
+	// The capacity is rounded up to a power of 2; one above the largest power of 2 throws std::length_error. try_push() fails when the queue is full
+	// and try_pop() fails when it is empty; neither ever blocks.
+	//
+	// A side declared single ( MultiProducer or MultiConsumer == false ) must be used by one thread
+	// at a time, and claims its slots with plain loads and stores instead of a CAS loop.
+	template < typename T, bool MultiProducer = true, bool MultiConsumer = true >
+	class bounded_queue
+	{
+		static_assert( std::is_nothrow_move_constructible_v< T >, "bounded_queue requires a nothrow move constructible type." );
+		static_assert( std::is_nothrow_move_assignable_v< T >, "bounded_queue requires a nothrow move assignable type." );
+		static_assert( std::is_nothrow_destructible_v< T >, "bounded_queue requires a nothrow destructible type." );
+	public:
+		typedef T value_type;
+
+		explicit bounded_queue( std::size_t capacity )
+			: m_mask( RoundUpCapacity( capacity ) - 1 )
+			, m_cells( new cell[m_mask + 1] )
+		{
+			for ( std::size_t i = 0; i <= m_mask; ++i )
+				m_cells[i].sequence.store( i, std::memory_order_relaxed );
+		}
+
+		~bounded_queue()
+		{
+			std::size_t last = m_enqueuePos.load( std::memory_order_relaxed );
+
+			for ( std::size_t pos = m_dequeuePos.load( std::memory_order_relaxed ); pos != last; ++pos )
+				std::launder( reinterpret_cast< T* >( m_cells[pos & m_mask].storage ) )->~T();
+		}
+
+		bounded_queue( const bounded_queue& ) = delete;
+		bounded_queue& operator = ( const bounded_queue& ) = delete;
+
+		std::size_t capacity() const noexcept
+		{
+			return m_mask + 1;
+		}
+
+		// Only a snapshot while other threads push or pop.
+		std::size_t size_approx() const noexcept
+		{
+			std::size_t tail = m_enqueuePos.load( std::memory_order_relaxed );
+			std::size_t head = m_dequeuePos.load( std::memory_order_relaxed );
+
+			return ( tail > head ) ? tail - head : 0;
+		}
+
+		bool try_push( const T& value )
+		{
+			return try_emplace( value );
+		}
+
+		bool try_push( T&& value ) noexcept
+		{
+			return try_emplace( std::move( value ) );
+		}
+
+		// The value is constructed before a slot is claimed, so a throwing constructor leaves the queue intact.
+		template < typename... Args >
+		bool try_emplace( Args&&... args )
+		{
+			if constexpr ( sizeof...( Args ) == 1 && ( std::is_same_v< Args, T > && ... ) )
+			{
+				return push_value( std::forward< Args >( args )... );
+			}
+			else
+			{
+				T value( std::forward< Args >( args )... );
+				return push_value( std::move( value ) );
+			}
+		}
+
+		bool try_pop( T& value ) noexcept
+		{
+			cell* c;
+			std::size_t pos;
+
+			if ( !claim( m_dequeuePos, 1, MultiConsumer, c, pos ) )
+				return false;
+
+			T* p = std::launder( reinterpret_cast< T* >( c->storage ) );
+			value = std::move( *p );
+			p->~T();
+
+			c->sequence.store( pos + m_mask + 1, std::memory_order_release );
+			return true;
+		}
+
+		// Pushes items from first until count items are pushed or the queue is full.
+		// Returns the number pushed.
+		template < typename InputIt >
+		std::size_t try_push_bulk( InputIt first, std::size_t count )
+		{
+			std::size_t n = 0;
+
+			for ( ; n < count; ++n, ++first )
+			{
+				if ( !try_push( *first ) )
+					break;
+			}
+
+			return n;
+		}
+
+		// Pops up to max items into out, and returns the number popped.
+		// Each item leaves its slot before it is written to out, so a throwing out loses that item but not the queue.
+		template < typename OutputIt >
+		std::size_t try_pop_bulk( OutputIt out, std::size_t max )
+		{
+			std::size_t n = 0;
+
+			for ( ; n < max; ++n )
+			{
+				cell* c;
+				std::size_t pos;
+
+				if ( !claim( m_dequeuePos, 1, MultiConsumer, c, pos ) )
+					break;
+
+				T* p = std::launder( reinterpret_cast< T* >( c->storage ) );
+				T value( std::move( *p ) );
+				p->~T();
+
+				c->sequence.store( pos + m_mask + 1, std::memory_order_release );
+
+				*out++ = std::move( value );
+			}
+
+			return n;
+		}
+	private:
+		struct cell
+		{
+			std::atomic< std::size_t > sequence;
+			alignas( T ) unsigned char storage[sizeof( T )];
+		};
+
+		static std::size_t RoundUpCapacity( std::size_t n )
+		{
+			// Above the largest power of 2, the loop below would never end.
+			if ( n > std::numeric_limits< std::size_t >::max() / 2 + 1 )
+				throw std::length_error( "bounded_queue capacity is too large" );
+
+			std::size_t capacity = 2;
+
+			while ( capacity < n )
+				capacity <<= 1;
+
+			return capacity;
+		}
+
+		bool push_value( T&& value ) noexcept
+		{
+			cell* c;
+			std::size_t pos;
+
+			if ( !claim( m_enqueuePos, 0, MultiProducer, c, pos ) )
+				return false;
+
+			new ( c->storage ) T( std::move( value ) );
+
+			c->sequence.store( pos + 1, std::memory_order_release );
+			return true;
+		}
+
+		// A slot at pos is ready for producers when its sequence is pos, and for consumers when it is pos + 1.
+		bool claim( std::atomic< std::size_t >& position, std::size_t ready, bool shared, cell*& c, std::size_t& pos ) noexcept
+		{
+			pos = position.load( std::memory_order_relaxed );
+
+			for ( ;; )
+			{
+				c = &m_cells[pos & m_mask];
+
+				std::size_t sequence = c->sequence.load( std::memory_order_acquire );
+				std::ptrdiff_t diff = static_cast< std::ptrdiff_t >( sequence - ( pos + ready ) );
+
+				if ( diff == 0 )
+				{
+					if ( !shared )
+					{
+						position.store( pos + 1, std::memory_order_relaxed );
+						return true;
+					}
+
+					if ( position.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+						return true;
+				}
+				else if ( diff < 0 )
+				{
+					// Full for producers, empty for consumers.
+					return false;
+				}
+				else
+				{
+					pos = position.load( std::memory_order_relaxed );
+				}
+			}
+		}
+
+		const std::size_t m_mask;
+		const std::unique_ptr< cell[] > m_cells;
+		alignas( details::CACHE_LINE_SIZE ) std::atomic< std::size_t > m_enqueuePos = 0;
+		alignas( details::CACHE_LINE_SIZE ) std::atomic< std::size_t > m_dequeuePos = 0;
+	};
+
+	template < typename T >
+	using mpmc_queue = bounded_queue< T, true, true >;
+
+	template < typename T >
+	using mpsc_queue = bounded_queue< T, true, false >;
+
+	template < typename T >
+	using spsc_queue = bounded_queue< T, false, false >;
+}
+
+#if defined( MYCPP_GLOBALTYPEDES )
+using MyCpp::bounded_queue;
+using MyCpp::mpmc_queue;
+using MyCpp::mpsc_queue;
+using MyCpp::spsc_queue;
+#endif
+
+#endif // ! __MYCPP_CONCURRENTQUEUE_HPP__
@@ -4,5 +4,7 @@
 
 #define MYCPP_GLOBALTYPEDES 1
 // #define MYCPP_NOAUTOLINKLIB 1
+// #define MYCPP_ALLOCATION_TRACKING 1
+// #define MYCPP_LOCK_PROFILING 1
 
 #endif // ! __MYCPP_CONFIG_HPP__
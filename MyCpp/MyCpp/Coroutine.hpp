@@ -0,0 +1,376 @@
+#pragma once
+
+#ifndef __MYCPP_COROUTINE_HPP__
+#define __MYCPP_COROUTINE_HPP__
+
+#include "MyCpp/Base.hpp"
+
+#if MYCPP_STDCPP_VERSION >= 202002L
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <utility>
+#include "MyCpp/Win32System.hpp"
+#include "MyCpp/ThreadPool.hpp"
+
+namespace MyCpp
+{
+	template < typename T = void >
+	class task;
+
+	namespace details
+	{
+		struct task_promise_base
+		{
+			struct final_awaiter
+			{
+				bool await_ready() const noexcept
+				{
+					return false;
+				}
+
+				template < typename Promise >
+				std::coroutine_handle<> await_suspend( std::coroutine_handle< Promise > h ) const noexcept
+				{
+					return h.promise().continuation;
+				}
+
+				void await_resume() const noexcept
+				{}
+			};
+
+			std::suspend_always initial_suspend() const noexcept
+			{
+				return {};
+			}
+
+			final_awaiter final_suspend() const noexcept
+			{
+				return {};
+			}
+
+			void unhandled_exception() noexcept
+			{
+				error = std::current_exception();
+			}
+
+			std::coroutine_handle<> continuation = std::noop_coroutine();
+			std::exception_ptr error;
+		};
+
+		template < typename T >
+		struct task_promise : task_promise_base
+		{
+			task< T > get_return_object() noexcept;
+
+			template < typename U >
+			void return_value( U&& v )
+			{
+				value.emplace( std::forward< U >( v ) );
+			}
+
+			T result()
+			{
+				if ( error )
+					std::rethrow_exception( error );
+
+				return std::move( *value );
+			}
+
+			std::optional< T > value;
+		};
+
+		template <>
+		struct task_promise< void > : task_promise_base
+		{
+			task< void > get_return_object() noexcept;
+
+			void return_void() const noexcept
+			{}
+
+			void result()
+			{
+				if ( error )
+					std::rethrow_exception( error );
+			}
+		};
+
+		// A coroutine that starts at once and frees itself when it finishes.
+		struct detached_task
+		{
+			struct promise_type
+			{
+				detached_task get_return_object() const noexcept
+				{
+					return {};
+				}
+
+				std::suspend_never initial_suspend() const noexcept
+				{
+					return {};
+				}
+
+				std::suspend_never final_suspend() const noexcept
+				{
+					return {};
+				}
+
+				void return_void() const noexcept
+				{}
+
+				void unhandled_exception() const noexcept
+				{
+					std::terminate();
+				}
+			};
+		};
+	}
+
+	// A lazily started coroutine that produces a T.
+	// It runs when it is awaited, and resumes its awaiter when it finishes, without recursion.
+	template < typename T >
+	class task
+	{
+	public:
+		typedef details::task_promise< T > promise_type;
+
+		task( task&& right ) noexcept
+			: m_handle( std::exchange( right.m_handle, {} ) )
+		{}
+
+		task& operator = ( task&& right ) noexcept
+		{
+			if ( this != &right )
+			{
+				if ( m_handle )
+					m_handle.destroy();
+
+				m_handle = std::exchange( right.m_handle, {} );
+			}
+
+			return *this;
+		}
+
+		task( const task& ) = delete;
+		task& operator = ( const task& ) = delete;
+
+		~task()
+		{
+			if ( m_handle )
+				m_handle.destroy();
+		}
+
+		bool await_ready() const noexcept
+		{
+			return m_handle.done();
+		}
+
+		std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept
+		{
+			m_handle.promise().continuation = awaiting;
+			return m_handle;
+		}
+
+		T await_resume()
+		{
+			return m_handle.promise().result();
+		}
+	private:
+		friend promise_type;
+
+		explicit task( std::coroutine_handle< promise_type > h ) noexcept
+			: m_handle( h )
+		{}
+
+		std::coroutine_handle< promise_type > m_handle;
+	};
+
+	namespace details
+	{
+		template < typename T >
+		inline task< T > task_promise< T >::get_return_object() noexcept
+		{
+			return task< T >( std::coroutine_handle< task_promise< T > >::from_promise( *this ) );
+		}
+
+		inline task< void > task_promise< void >::get_return_object() noexcept
+		{
+			return task< void >( std::coroutine_handle< task_promise< void > >::from_promise( *this ) );
+		}
+
+		template < typename T >
+		detached_task sync_wait_run( task< T >& t, std::promise< T >& result )
+		{
+			try
+			{
+				if constexpr ( std::is_void_v< T > )
+				{
+					co_await t;
+					result.set_value();
+				}
+				else
+				{
+					result.set_value( co_await t );
+				}
+			}
+			catch ( ... )
+			{
+				result.set_exception( std::current_exception() );
+			}
+		}
+
+		inline detached_task spawn_run( thread_pool& pool, task<> t );
+	}
+
+	// Runs t to the end, blocking the calling thread, and returns its result.
+	template < typename T >
+	T sync_wait( task< T > t )
+	{
+		std::promise< T > result;
+		std::future< T > future = result.get_future();
+
+		details::sync_wait_run( t, result );
+
+		return future.get();
+	}
+
+	// Resumes the awaiting coroutine on a worker of pool.
+	class schedule_awaiter
+	{
+	public:
+		explicit schedule_awaiter( thread_pool& pool ) noexcept
+			: m_pool( pool )
+		{}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		void await_suspend( std::coroutine_handle<> h ) const
+		{
+			m_pool.post( [h] { h.resume(); } );
+		}
+
+		void await_resume() const noexcept
+		{}
+	private:
+		thread_pool& m_pool;
+	};
+
+	inline schedule_awaiter schedule( thread_pool& pool = thread_pool::shared() )
+	{
+		return schedule_awaiter( pool );
+	}
+
+	// Starts t on a worker of pool and does not wait for it. An exception that escapes t terminates the process.
+	inline void spawn( task<> t, thread_pool& pool = thread_pool::shared() )
+	{
+		details::spawn_run( pool, std::move( t ) );
+	}
+
+	inline details::detached_task details::spawn_run( thread_pool& pool, task<> t )
+	{
+		co_await schedule( pool );
+		co_await t;
+	}
+
+	// Waits for a kernel object without holding a thread. The wait is a thread pool wait object
+	// ( CreateThreadpoolWait() ), which the system batches onto its shared wait threads without a fixed
+	// limit of waits per thread, and the coroutine resumes on a worker of pool.
+	// co_await yields true if the object was signaled, false if the timeout elapsed.
+	// Events, processes, threads, change notifications and the events of OVERLAPPED I/O can be awaited.
+	class handle_wait_awaiter
+	{
+	public:
+		handle_wait_awaiter( handle_t handle, dword milliseconds, thread_pool& pool ) noexcept
+			: m_handle( handle )
+			, m_milliseconds( milliseconds )
+			, m_pool( pool )
+		{}
+
+		handle_wait_awaiter( const handle_wait_awaiter& ) = delete;
+		handle_wait_awaiter& operator = ( const handle_wait_awaiter& ) = delete;
+
+		~handle_wait_awaiter();
+
+		bool await_ready();
+		bool await_suspend( std::coroutine_handle<> h );
+		bool await_resume() const noexcept;
+	private:
+		static void CALLBACK Completed( PTP_CALLBACK_INSTANCE instance, void* context, PTP_WAIT wait, TP_WAIT_RESULT result );
+
+		handle_t m_handle;
+		dword m_milliseconds;
+		thread_pool& m_pool;
+		PTP_WAIT m_wait = null;
+		std::coroutine_handle<> m_continuation;
+		std::atomic< bool > m_arrived = false;		// set by whichever of await_suspend() and the callback comes first
+		bool m_signaled = false;
+	};
+
+	inline handle_wait_awaiter async_wait( handle_t handle, dword milliseconds = INFINITE, thread_pool& pool = thread_pool::shared() )
+	{
+		return handle_wait_awaiter( handle, milliseconds, pool );
+	}
+
+	// Waits for process to exit. co_await yields true if it exited, false if the timeout elapsed.
+	inline task< bool > async_wait( processptr_t process, dword milliseconds = INFINITE, thread_pool& pool = thread_pool::shared() )
+	{
+		co_return co_await async_wait( process->GetHandle(), milliseconds, pool );
+	}
+
+	// Resumes the coroutine on a worker of pool after duration, using a thread pool timer ( CreateThreadpoolTimer() ).
+	class sleep_awaiter
+	{
+	public:
+		sleep_awaiter( std::chrono::milliseconds duration, thread_pool& pool ) noexcept
+			: m_duration( duration )
+			, m_pool( pool )
+		{}
+
+		sleep_awaiter( const sleep_awaiter& ) = delete;
+		sleep_awaiter& operator = ( const sleep_awaiter& ) = delete;
+
+		~sleep_awaiter();
+
+		bool await_ready() const noexcept
+		{
+			return ( m_duration.count() <= 0 );
+		}
+
+		bool await_suspend( std::coroutine_handle<> h );
+
+		void await_resume() const noexcept
+		{}
+	private:
+		static void CALLBACK Elapsed( PTP_CALLBACK_INSTANCE instance, void* context, PTP_TIMER timer );
+
+		std::chrono::milliseconds m_duration;
+		thread_pool& m_pool;
+		PTP_TIMER m_timer = null;
+		std::coroutine_handle<> m_continuation;
+		std::atomic< bool > m_arrived = false;
+	};
+
+	inline sleep_awaiter async_sleep( std::chrono::milliseconds duration, thread_pool& pool = thread_pool::shared() )
+	{
+		return sleep_awaiter( duration, pool );
+	}
+}
+
+#if defined( MYCPP_GLOBALTYPEDES )
+using MyCpp::task;
+using MyCpp::sync_wait;
+using MyCpp::spawn;
+using MyCpp::schedule;
+using MyCpp::async_wait;
+using MyCpp::async_sleep;
+#endif
+
+#endif // MYCPP_STDCPP_VERSION >= 202002L
+
+#endif // ! __MYCPP_COROUTINE_HPP__
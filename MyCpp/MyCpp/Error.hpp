@@ -45,6 +45,7 @@ namespace MyCpp
 				{
 					std::fill_n( memptr, memsize, charT() );
 					std::free( reinterpret_cast< void* >( memptr ) );
+					MYCPP_TRACK_DEALLOCATION( alloc_tag::text_buffer, memsize * sizeof( charT ) );
 				}
 				else if ( memptr == fixed_storage )
 				{
@@ -75,6 +76,10 @@ namespace MyCpp
 					memptr = fixed_storage;
 					memsize = count_of( fixed_storage );
 				}
+				else if ( memptr != fixed_storage )
+				{
+					MYCPP_TRACK_ALLOCATION( alloc_tag::text_buffer, memsize * sizeof( charT ) );
+				}
 
 				std::fill_n( memptr, memsize, charT() );
 
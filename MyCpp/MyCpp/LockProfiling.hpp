@@ -0,0 +1,89 @@
+#pragma once
+
+#ifndef __MYCPP_LOCKPROFILING_HPP__
+#define __MYCPP_LOCKPROFILING_HPP__
+
+#include <chrono>
+#include "MyCpp/Base.hpp"
+
+// Lock profiling is enabled by defining MYCPP_LOCK_PROFILING in Config.hpp.
+// When it is not defined, lock_site is an empty struct, the lock guards carry no state
+// and TryLockCriticalSection() / TryLockMutex() record nothing.
+//
+// Pass MYCPP_LOCK_SITE to the lock functions to attribute an acquisition to its call site:
+//     cslock_t lock = TryLockCriticalSection( cs, MYCPP_LOCK_SITE );
+#if defined( MYCPP_LOCK_PROFILING )
+#define MYCPP_LOCK_SITE MyCpp::lock_site{ __FILE__, __LINE__ }
+#else
+#define MYCPP_LOCK_SITE MyCpp::lock_site{}
+#endif
+
+namespace MyCpp
+{
+	struct lock_site
+	{
+#if defined( MYCPP_LOCK_PROFILING )
+		const char* file = null;
+		int line = 0;
+#endif
+	};
+
+	// One lock at one call site.
+	struct lock_stats
+	{
+		const void* lock;		// CRITICAL_SECTION address; null for a named mutex
+		string_t name;			// name of a named mutex
+		const char* file;		// call site; null if MYCPP_LOCK_SITE was not given
+		int line;
+		qword acquisitions;
+		qword contended;		// acquisitions that had to wait
+		std::chrono::nanoseconds wait_time;		// total over the contended acquisitions
+		std::chrono::nanoseconds max_hold_time;
+	};
+
+	// Merges the counters of all threads.
+	// Returns an empty vector when MYCPP_LOCK_PROFILING is not defined.
+	std::vector< lock_stats > GetLockProfile();
+
+	// The n entries with the longest total wait time, hottest first.
+	std::vector< lock_stats > GetHottestLocks( std::size_t n );
+
+	void ResetLockProfile();
+
+	namespace details
+	{
+		struct lock_record;
+
+		// Returns null if the record could not be allocated.
+		lock_record* RecordLockAcquisition( const void* lock, const string_t* name, const lock_site& site, bool contended, std::chrono::nanoseconds waitTime ) noexcept;
+		void RecordLockRelease( lock_record* record, std::chrono::nanoseconds holdTime ) noexcept;
+
+		// Base of the lock guard deleters. Empty when profiling is disabled,
+		// so the guards stay the size of a pointer.
+		struct lock_hold
+		{
+#if defined( MYCPP_LOCK_PROFILING )
+			lock_record* record = null;
+			std::chrono::steady_clock::time_point acquired;
+#endif
+
+			void release_hold() noexcept
+			{
+#if defined( MYCPP_LOCK_PROFILING )
+				if ( record != null )
+				{
+					RecordLockRelease( record, std::chrono::steady_clock::now() - acquired );
+					record = null;
+				}
+#endif
+			}
+		};
+	}
+}
+
+#if defined( MYCPP_GLOBALTYPEDES )
+using MyCpp::lock_site;
+using MyCpp::lock_stats;
+#endif
+
+#endif // ! __MYCPP_LOCKPROFILING_HPP__
@@ -0,0 +1,213 @@
+#pragma once
+
+#ifndef __MYCPP_MEMORYTRACKING_HPP__
+#define __MYCPP_MEMORYTRACKING_HPP__
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include "MyCpp/Base.hpp"
+
+// Allocation tracking is enabled by defining MYCPP_ALLOCATION_TRACKING in Config.hpp.
+// When it is not defined, the tracking macros expand to nothing and
+// tracked_allocator<> is std::allocator<>, so no code is generated at all.
+#if defined( MYCPP_ALLOCATION_TRACKING )
+#define MYCPP_TRACK_ALLOCATION( tag, bytes ) \
+	MyCpp::details::RecordAllocation( ( tag ), ( bytes ) )
+#define MYCPP_TRACK_DEALLOCATION( tag, bytes ) \
+	MyCpp::details::RecordDeallocation( ( tag ), ( bytes ) )
+#else
+#define MYCPP_TRACK_ALLOCATION( tag, bytes ) ( ( void )0 )
+#define MYCPP_TRACK_DEALLOCATION( tag, bytes ) ( ( void )0 )
+#endif
+
+namespace MyCpp
+{
+	// Call-site tags. Each tag owns one set of counters.
+	enum class alloc_tag : uint
+	{
+		generic,
+		system_buffer,		// temporary buffers of Win32System / Win32Resource (adaptive_load callers)
+		text_buffer,		// safe_text_buffer spills
+		string_format,		// vcsprintf(), strprintf(), narrow_wide_string()
+		local_memory,		// lcallocate(), make_*_local_memory*()
+		global_memory,		// glallocate(), make_*_global_memory*()
+		heap_memory,		// hpallocate(), make_*_heap_memory()
+		virtual_memory,		// vtallocate(), make_*_virtual_memory()
+		user,				// free for application use
+		count_
+	};
+
+	constexpr std::size_t ALLOC_TAG_COUNT = static_cast< std::size_t >( alloc_tag::count_ );
+
+	struct allocation_stats
+	{
+		std::size_t allocations;
+		std::size_t deallocations;
+		std::size_t allocated_bytes;
+		std::size_t deallocated_bytes;
+		std::size_t live_bytes;
+		std::size_t peak_bytes;		// high-water mark of live_bytes
+	};
+
+	typedef std::array< allocation_stats, ALLOC_TAG_COUNT > allocation_snapshot;
+
+	// Returns zero-filled stats when MYCPP_ALLOCATION_TRACKING is not defined.
+	allocation_snapshot GetAllocationSnapshot();
+	allocation_stats GetAllocationStats( alloc_tag tag );
+	void ResetAllocationCounters();
+	const char_t* GetAllocationTagName( alloc_tag tag );
+
+	namespace details
+	{
+		void RecordAllocation( alloc_tag tag, std::size_t bytes ) noexcept;
+		void RecordDeallocation( alloc_tag tag, std::size_t bytes ) noexcept;
+
+		template < typename T, alloc_tag Tag >
+		class tracking_allocator
+		{
+		public:
+			typedef T value_type;
+
+			template < typename U >
+			struct rebind
+			{
+				typedef tracking_allocator< U, Tag > other;
+			};
+
+			tracking_allocator() noexcept = default;
+
+			template < typename U >
+			tracking_allocator( const tracking_allocator< U, Tag >& ) noexcept
+			{}
+
+			T* allocate( std::size_t n )
+			{
+				T* p = std::allocator< T >().allocate( n );
+				RecordAllocation( Tag, n * sizeof( T ) );
+				return p;
+			}
+
+			void deallocate( T* p, std::size_t n ) noexcept
+			{
+				RecordDeallocation( Tag, n * sizeof( T ) );
+				std::allocator< T >().deallocate( p, n );
+			}
+		};
+
+		template < typename T, typename U, alloc_tag Tag >
+		constexpr bool operator == ( const tracking_allocator< T, Tag >&, const tracking_allocator< U, Tag >& ) noexcept
+		{
+			return true;
+		}
+
+		template < typename T, typename U, alloc_tag Tag >
+		constexpr bool operator != ( const tracking_allocator< T, Tag >&, const tracking_allocator< U, Tag >& ) noexcept
+		{
+			return false;
+		}
+	}
+
+#if defined( MYCPP_ALLOCATION_TRACKING )
+	template < typename T, alloc_tag Tag >
+	using tracked_allocator = details::tracking_allocator< T, Tag >;
+#else
+	template < typename T, alloc_tag Tag >
+	using tracked_allocator = std::allocator< T >;
+#endif
+
+	template < typename T, alloc_tag Tag >
+	using tracked_vector = std::vector< T, tracked_allocator< T, Tag > >;
+
+	// std::pmr::memory_resource that forwards to an upstream resource,
+	// keeps its own counters and also reports to the counters of its tag.
+	// The per-instance counters are always maintained, since using this
+	// resource is an explicit request for instrumentation.
+	class counting_memory_resource : public std::pmr::memory_resource
+	{
+	public:
+		explicit counting_memory_resource( alloc_tag tag = alloc_tag::user, std::pmr::memory_resource* upstream = std::pmr::get_default_resource() ) noexcept
+			: m_tag( tag )
+			, m_upstream( upstream )
+		{}
+
+		counting_memory_resource( const counting_memory_resource& ) = delete;
+		counting_memory_resource& operator = ( const counting_memory_resource& ) = delete;
+
+		allocation_stats stats() const noexcept
+		{
+			return
+			{
+				m_allocations.load( std::memory_order_relaxed ),
+				m_deallocations.load( std::memory_order_relaxed ),
+				m_allocated_bytes.load( std::memory_order_relaxed ),
+				m_deallocated_bytes.load( std::memory_order_relaxed ),
+				m_live_bytes.load( std::memory_order_relaxed ),
+				m_peak_bytes.load( std::memory_order_relaxed )
+			};
+		}
+
+		alloc_tag tag() const noexcept
+		{
+			return m_tag;
+		}
+
+		std::pmr::memory_resource* upstream_resource() const noexcept
+		{
+			return m_upstream;
+		}
+	protected:
+		void* do_allocate( std::size_t bytes, std::size_t alignment ) override
+		{
+			void* p = m_upstream->allocate( bytes, alignment );
+
+			m_allocations.fetch_add( 1, std::memory_order_relaxed );
+			m_allocated_bytes.fetch_add( bytes, std::memory_order_relaxed );
+
+			std::size_t live = m_live_bytes.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+			std::size_t peak = m_peak_bytes.load( std::memory_order_relaxed );
+
+			while ( live > peak && !m_peak_bytes.compare_exchange_weak( peak, live, std::memory_order_relaxed ) )
+				;
+
+			MYCPP_TRACK_ALLOCATION( m_tag, bytes );
+
+			return p;
+		}
+
+		void do_deallocate( void* p, std::size_t bytes, std::size_t alignment ) override
+		{
+			MYCPP_TRACK_DEALLOCATION( m_tag, bytes );
+
+			m_deallocations.fetch_add( 1, std::memory_order_relaxed );
+			m_deallocated_bytes.fetch_add( bytes, std::memory_order_relaxed );
+			m_live_bytes.fetch_sub( bytes, std::memory_order_relaxed );
+
+			m_upstream->deallocate( p, bytes, alignment );
+		}
+
+		bool do_is_equal( const std::pmr::memory_resource& other ) const noexcept override
+		{
+			return ( this == &other );
+		}
+	private:
+		alloc_tag m_tag;
+		std::pmr::memory_resource* m_upstream;
+		std::atomic< std::size_t > m_allocations = 0;
+		std::atomic< std::size_t > m_deallocations = 0;
+		std::atomic< std::size_t > m_allocated_bytes = 0;
+		std::atomic< std::size_t > m_deallocated_bytes = 0;
+		std::atomic< std::size_t > m_live_bytes = 0;
+		std::atomic< std::size_t > m_peak_bytes = 0;
+	};
+}
+
+#if defined( MYCPP_GLOBALTYPEDES )
+using MyCpp::alloc_tag;
+using MyCpp::allocation_stats;
+using MyCpp::allocation_snapshot;
+using MyCpp::counting_memory_resource;
+#endif
+
+#endif // ! __MYCPP_MEMORYTRACKING_HPP__
@@ -0,0 +1,292 @@
+#pragma once
+
+#ifndef __MYCPP_SMALLVECTOR_HPP__
+#define __MYCPP_SMALLVECTOR_HPP__
+
+#include <cstring>
+#include <stdexcept>
+#include "MyCpp/StringUtils.hpp"
+#include "MyCpp/MemoryTracking.hpp"
+
+namespace MyCpp
+{
+	// A vector of trivially copyable elements that keeps up to N elements inline.
+	// It moves to the heap only when it has to grow past N, so it can be handed to
+	// adaptive_load() as a scratch buffer that usually makes no heap allocation.
+	// Heap blocks are reported under Tag when allocation tracking is enabled.
+	template < typename T, std::size_t N, alloc_tag Tag = alloc_tag::generic >
+	class small_vector
+	{
+		static_assert( std::is_trivially_copyable_v< T >, "small_vector requires a trivially copyable type." );
+		static_assert( N > 0, "small_vector requires an inline capacity." );
+	public:
+		typedef T value_type;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T& reference;
+		typedef const T& const_reference;
+		typedef T* pointer;
+		typedef const T* const_pointer;
+		typedef T* iterator;
+		typedef const T* const_iterator;
+
+		static constexpr size_type inline_capacity = N;
+
+		small_vector() noexcept = default;
+
+		explicit small_vector( size_type n )
+		{
+			resize( n );
+		}
+
+		small_vector( size_type n, const T& value )
+		{
+			resize( n, value );
+		}
+
+		small_vector( const small_vector& other )
+		{
+			assign( other.begin(), other.end() );
+		}
+
+		small_vector( small_vector&& other ) noexcept
+		{
+			move_from( other );
+		}
+
+		~small_vector()
+		{
+			release();
+		}
+
+		small_vector& operator = ( const small_vector& other )
+		{
+			if ( this != &other )
+				assign( other.begin(), other.end() );
+
+			return *this;
+		}
+
+		small_vector& operator = ( small_vector&& other ) noexcept
+		{
+			if ( this != &other )
+			{
+				release();
+				move_from( other );
+			}
+
+			return *this;
+		}
+
+		void assign( const T* first, const T* last )
+		{
+			size_type n = static_cast< size_type >( last - first );
+
+			m_size = 0;
+			reserve( n );
+
+			if ( n > 0 )
+				std::memmove( m_data, first, n * sizeof( T ) );
+
+			m_size = n;
+		}
+
+		T* data() noexcept { return m_data; }
+		const T* data() const noexcept { return m_data; }
+
+		size_type size() const noexcept { return m_size; }
+		size_type capacity() const noexcept { return m_capacity; }
+		bool empty() const noexcept { return ( m_size == 0 ); }
+
+		// true while the elements live in the inline storage.
+		bool is_inline() const noexcept { return ( m_data == inline_data() ); }
+
+		iterator begin() noexcept { return m_data; }
+		iterator end() noexcept { return m_data + m_size; }
+		const_iterator begin() const noexcept { return m_data; }
+		const_iterator end() const noexcept { return m_data + m_size; }
+		const_iterator cbegin() const noexcept { return m_data; }
+		const_iterator cend() const noexcept { return m_data + m_size; }
+
+		T& operator [] ( size_type i ) noexcept { return m_data[i]; }
+		const T& operator [] ( size_type i ) const noexcept { return m_data[i]; }
+
+		T& at( size_type i )
+		{
+			if ( i >= m_size )
+				throw std::out_of_range( "small_vector::at" );
+
+			return m_data[i];
+		}
+
+		const T& at( size_type i ) const
+		{
+			if ( i >= m_size )
+				throw std::out_of_range( "small_vector::at" );
+
+			return m_data[i];
+		}
+
+		T& front() noexcept { return m_data[0]; }
+		const T& front() const noexcept { return m_data[0]; }
+		T& back() noexcept { return m_data[m_size - 1]; }
+		const T& back() const noexcept { return m_data[m_size - 1]; }
+
+		void reserve( size_type n )
+		{
+			if ( n > m_capacity )
+				reallocate( n );
+		}
+
+		// New elements are value-initialized, as std::vector does.
+		void resize( size_type n )
+		{
+			resize( n, T() );
+		}
+
+		void resize( size_type n, const T& value )
+		{
+			reserve( n );
+
+			if ( n > m_size )
+				std::fill( m_data + m_size, m_data + n, value );
+
+			m_size = n;
+		}
+
+		void push_back( const T& value )
+		{
+			if ( m_size == m_capacity )
+			{
+				T copy = value;	// value may refer to an element of this vector.
+				reallocate( m_capacity * 2 );
+				m_data[m_size++] = copy;
+			}
+			else
+			{
+				m_data[m_size++] = value;
+			}
+		}
+
+		void pop_back() noexcept
+		{
+			--m_size;
+		}
+
+		void clear() noexcept
+		{
+			m_size = 0;
+		}
+
+		// Returns to the inline storage if the elements fit in it.
+		void shrink_to_fit()
+		{
+			if ( !is_inline() && m_size <= N )
+			{
+				T* heap = m_data;
+				size_type heapCapacity = m_capacity;
+
+				if ( m_size > 0 )
+					std::memcpy( inline_data(), heap, m_size * sizeof( T ) );
+
+				m_data = inline_data();
+				m_capacity = N;
+
+				deallocate( heap, heapCapacity );
+			}
+		}
+	private:
+		typedef tracked_allocator< T, Tag > allocator_type;
+
+		T* inline_data() noexcept
+		{
+			return reinterpret_cast< T* >( m_storage );
+		}
+
+		const T* inline_data() const noexcept
+		{
+			return reinterpret_cast< const T* >( m_storage );
+		}
+
+		static void deallocate( T* p, size_type n ) noexcept
+		{
+			allocator_type().deallocate( p, n );
+		}
+
+		void reallocate( size_type n )
+		{
+			T* p = allocator_type().allocate( n );
+
+			if ( m_size > 0 )
+				std::memcpy( p, m_data, m_size * sizeof( T ) );
+
+			if ( !is_inline() )
+				deallocate( m_data, m_capacity );
+
+			m_data = p;
+			m_capacity = n;
+		}
+
+		void release() noexcept
+		{
+			if ( !is_inline() )
+				deallocate( m_data, m_capacity );
+
+			m_data = inline_data();
+			m_capacity = N;
+			m_size = 0;
+		}
+
+		void move_from( small_vector& other ) noexcept
+		{
+			if ( other.is_inline() )
+			{
+				if ( other.m_size > 0 )
+					std::memcpy( inline_data(), other.m_data, other.m_size * sizeof( T ) );
+
+				m_data = inline_data();
+				m_capacity = N;
+			}
+			else
+			{
+				m_data = other.m_data;
+				m_capacity = other.m_capacity;
+
+				other.m_data = other.inline_data();
+				other.m_capacity = N;
+			}
+
+			m_size = other.m_size;
+			other.m_size = 0;
+		}
+
+		alignas( T ) unsigned char m_storage[N * sizeof( T )];
+		T* m_data = inline_data();
+		size_type m_size = 0;
+		size_type m_capacity = N;
+	};
+
+	template < typename CharT, std::size_t N, alloc_tag Tag >
+	inline CharT* cstr_t( small_vector< CharT, N, Tag >& v )
+	{
+		return v.data();
+	}
+
+	template < typename CharT, std::size_t N, alloc_tag Tag >
+	inline const CharT* cstr_t( const small_vector< CharT, N, Tag >& v )
+	{
+		return v.data();
+	}
+
+	template < typename charT, std::size_t N, alloc_tag Tag >
+	inline const charT* printf_arg( const small_vector< charT, N, Tag >& value ) noexcept
+	{
+		return cstr_t( value );
+	}
+}
+
+#if defined( MYCPP_GLOBALTYPEDES )
+using MyCpp::small_vector;
+#endif
+
+#endif // ! __MYCPP_SMALLVECTOR_HPP__
@@ -7,6 +7,7 @@
 #include <iterator>
 #include <algorithm>
 #include "MyCpp/Base.hpp"
+#include "MyCpp/MemoryTracking.hpp"
 
 namespace MyCpp
 {
@@ -88,7 +89,7 @@ namespace MyCpp
 		typedef typename StringTo::value_type CharTo;
 
 		auto converter = narrow_wide_converter< CharTo >( from.c_str(), from.length() );
-		std::vector< CharTo > buffer( converter.requires_size() );
+		tracked_vector< CharTo, alloc_tag::string_format > buffer( converter.requires_size() );
 		std::size_t r = converter.convert( cstr_t( buffer ), buffer.size() );
 
 		return { cstr_t( buffer ), r };
@@ -106,8 +107,8 @@ namespace MyCpp
 		return value;
 	}
 
-	template < typename charT >
-	inline const charT* printf_arg( const std::vector< charT >& value ) noexcept
+	template < typename charT, typename Allocator >
+	inline const charT* printf_arg( const std::vector< charT, Allocator >& value ) noexcept
 	{
 		return cstr_t( value );
 	}
@@ -120,8 +121,8 @@ namespace MyCpp
 
 	namespace details
 	{
-		template < typename ... Args >
-		inline int vcsprintf( vchar& result, const char* fmt, const Args& ... args )
+		template < typename Allocator, typename ... Args >
+		inline int vcsprintf( std::vector< char, Allocator >& result, const char* fmt, const Args& ... args )
 		{
 			int r = _scprintf( fmt, printf_arg( args ) ... );
 
@@ -134,8 +135,8 @@ namespace MyCpp
 			return r;
 		}
 
-		template < typename ... Args >
-		inline int vcsprintf( vwchar& result, const wchar_t* fmt, const Args& ... args )
+		template < typename Allocator, typename ... Args >
+		inline int vcsprintf( std::vector< wchar_t, Allocator >& result, const wchar_t* fmt, const Args& ... args )
 		{
 			int r = _scwprintf( fmt, printf_arg( args ) ... );
 
@@ -164,7 +165,7 @@ namespace MyCpp
 	template < typename charT, typename ... Args  >
 	inline std::basic_string< charT > strprintf( const charT* fmt, const Args& ... args )
 	{
-		std::vector< charT > result;
+		tracked_vector< charT, alloc_tag::string_format > result;
 
 		int r = details::vcsprintf( result, fmt, args ... );
 		if ( r == -1 )
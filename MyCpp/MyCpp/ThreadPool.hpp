@@ -0,0 +1,215 @@
+#pragma once
+
+#ifndef __MYCPP_THREADPOOL_HPP__
+#define __MYCPP_THREADPOOL_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include "MyCpp/Base.hpp"
+
+namespace MyCpp
+{
+	namespace details
+	{
+		struct pool_task
+		{
+			virtual ~pool_task() = default;
+			virtual void run() = 0;
+		};
+
+		template < typename F >
+		struct pool_task_impl : pool_task
+		{
+			explicit pool_task_impl( F&& f )
+				: m_f( std::move( f ) )
+			{}
+
+			void run() override
+			{
+				m_f();
+			}
+
+			F m_f;
+		};
+
+		template < typename F >
+		inline std::unique_ptr< pool_task > make_pool_task( F&& f )
+		{
+			return std::make_unique< pool_task_impl< std::decay_t< F > > >( std::decay_t< F >( std::forward< F >( f ) ) );
+		}
+	}
+
+	// A work-stealing thread pool.
+	// Every worker owns a Chase-Lev deque. Tasks submitted from a worker go to its own deque
+	// and are run newest first, while idle workers steal the oldest tasks from the others.
+	// Tasks submitted from other threads go through a shared injection queue.
+	// Idle workers sleep until a task arrives.
+	class thread_pool
+	{
+	public:
+		// threads == 0 starts one worker per hardware thread.
+		// With pinThreads, worker n runs only on logical processor n ( modulo the processor count ).
+		explicit thread_pool( std::size_t threads = 0, bool pinThreads = false );
+
+		// Runs the tasks still queued, then stops the workers.
+		~thread_pool();
+
+		thread_pool( const thread_pool& ) = delete;
+		thread_pool& operator = ( const thread_pool& ) = delete;
+
+		std::size_t size() const noexcept;
+
+		template < typename F >
+		std::future< std::invoke_result_t< std::decay_t< F > > > submit( F&& f )
+		{
+			std::packaged_task< std::invoke_result_t< std::decay_t< F > >() > task( std::forward< F >( f ) );
+			auto future = task.get_future();
+
+			enqueue( details::make_pool_task( std::move( task ) ) );
+
+			return future;
+		}
+
+		// Queues f without a future. f must not throw.
+		template < typename F >
+		void post( F&& f )
+		{
+			enqueue( details::make_pool_task( std::forward< F >( f ) ) );
+		}
+
+		// Calls f( i ) for every i in [first, last), handing out grain indices at a time
+		// ( grain == 0 picks one that gives every worker several chunks ).
+		// The calling thread takes part, and also runs other queued tasks while it waits,
+		// so parallel_for() may be called from inside a task.
+		// If a call throws, the remaining chunks are skipped and the first exception is rethrown.
+		// At most maxThreads threads, counting the calling one, run f ( 0 means no limit ).
+		template < typename F >
+		void parallel_for( std::size_t first, std::size_t last, F&& f, std::size_t grain = 0, std::size_t maxThreads = 0 );
+
+		// Runs one queued task on the calling thread. Returns false if none was found.
+		bool run_pending_task();
+
+		// The pool shared by the library's bulk operations.
+		// It is created on first use, with one worker per hardware thread.
+		static thread_pool& shared();
+	private:
+		class work_deque;
+		struct worker;
+
+		void enqueue( std::unique_ptr< details::pool_task > task );
+		details::pool_task* find_task( std::size_t self );
+		void run( std::size_t index );
+
+		std::vector< std::unique_ptr< worker > > m_workers;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::unique_ptr< work_deque > m_injection;		// written under m_lock, stolen from without it
+		std::atomic< std::size_t > m_queued = 0;		// tasks pushed and not yet taken
+		std::atomic< std::size_t > m_sleeping = 0;
+		bool m_stop = false;
+	};
+
+	template < typename F >
+	void thread_pool::parallel_for( std::size_t first, std::size_t last, F&& f, std::size_t grain, std::size_t maxThreads )
+	{
+		if ( first >= last )
+			return;
+
+		const std::size_t count = last - first;
+		const std::size_t workers = size();
+
+		if ( grain == 0 )
+			grain = std::max< std::size_t >( count / ( workers * 4 + 1 ), 1 );
+
+		const std::size_t chunks = ( count + grain - 1 ) / grain;
+
+		struct shared_state
+		{
+			std::atomic< std::size_t > next;
+			std::atomic< std::size_t > running;
+			std::atomic< bool > failed;
+			std::exception_ptr error;
+		};
+
+		shared_state state;
+		state.next = first;
+		state.running = 0;
+		state.failed = false;
+
+		auto body =
+			[&state, &f, last, grain] ()
+		{
+			try
+			{
+				while ( !state.failed.load( std::memory_order_relaxed ) )
+				{
+					std::size_t begin = state.next.fetch_add( grain, std::memory_order_relaxed );
+
+					if ( begin >= last )
+						break;
+
+					std::size_t end = std::min( begin + grain, last );
+
+					for ( std::size_t i = begin; i < end; ++i )
+						f( i );
+				}
+			}
+			catch ( ... )
+			{
+				if ( !state.failed.exchange( true ) )
+					state.error = std::current_exception();
+			}
+		};
+
+		// A helper that starts after the range is used up returns at once.
+		std::size_t helpers = std::min( chunks, workers + 1 ) - 1;
+
+		if ( maxThreads != 0 )
+			helpers = std::min( helpers, maxThreads - 1 );
+
+		for ( std::size_t n = 0; n < helpers; ++n )
+		{
+			state.running.fetch_add( 1, std::memory_order_relaxed );
+
+			try
+			{
+				enqueue( details::make_pool_task(
+					[&state, &body] ()
+				{
+					body();
+					state.running.fetch_sub( 1, std::memory_order_release );
+				} ) );
+			}
+			catch ( ... )
+			{
+				// The helpers already queued and the calling thread share the remaining chunks.
+				state.running.fetch_sub( 1, std::memory_order_relaxed );
+				break;
+			}
+		}
+
+		body();
+
+		while ( state.running.load( std::memory_order_acquire ) != 0 )
+		{
+			if ( !run_pending_task() )
+				std::this_thread::yield();
+		}
+
+		if ( state.error )
+			std::rethrow_exception( state.error );
+	}
+}
+
+#if defined( MYCPP_GLOBALTYPEDES )
+using MyCpp::thread_pool;
+#endif
+
+#endif // ! __MYCPP_THREADPOOL_HPP__
@@ -5,9 +5,24 @@
 
 #include <memory>
 #include "MyCpp/Win32Base.hpp"
+#include "MyCpp/MemoryTracking.hpp"
 
 namespace MyCpp
 {
+	namespace details
+	{
+		// Size of the region reserved by VirtualAlloc(). Used only for allocation tracking.
+		inline std::size_t GetVirtualMemorySize( const void* p )
+		{
+			MEMORY_BASIC_INFORMATION mbi = {};
+
+			if ( ::VirtualQuery( p, &mbi, sizeof( mbi ) ) == 0 )
+				return 0;
+
+			return mbi.RegionSize;
+		}
+	}
+
 	template < typename T >
 	struct local_memory_deleter
 	{
@@ -15,7 +30,10 @@ namespace MyCpp
 		void operator () ( T* p )
 		{
 			if ( p != null )
+			{
+				MYCPP_TRACK_DEALLOCATION( alloc_tag::local_memory, ::LocalSize( reinterpret_cast< HLOCAL >( p ) ) );
 				::LocalFree( reinterpret_cast< HLOCAL >( p ) );
+			}
 		}
 	};
 
@@ -26,7 +44,10 @@ namespace MyCpp
 		void operator () ( T* p )
 		{
 			if ( p != null )
+			{
+				MYCPP_TRACK_DEALLOCATION( alloc_tag::global_memory, ::GlobalSize( reinterpret_cast< HGLOBAL >( p ) ) );
 				::GlobalFree( reinterpret_cast< HGLOBAL >( p ) );
+			}
 		}
 	};
 
@@ -37,7 +58,10 @@ namespace MyCpp
 		void operator () ( T* p )
 		{
 			if ( p != null )
+			{
+				MYCPP_TRACK_DEALLOCATION( alloc_tag::virtual_memory, details::GetVirtualMemorySize( p ) );
 				::VirtualFree( p, 0, MEM_RELEASE );
+			}
 		}
 	};
 
@@ -71,6 +95,7 @@ namespace MyCpp
 				details::heapmem_header* hdr = details::GetHeapMemoryHeader( p );
 				heaphadle_t hHeap = hdr->hHeap;
 
+				MYCPP_TRACK_DEALLOCATION( alloc_tag::heap_memory, ::HeapSize( hHeap, 0, hdr ) );
 				::HeapFree( hHeap, 0, hdr );
 
 				if ( hHeap != null && hHeap != ::GetProcessHeap() )
@@ -107,20 +132,26 @@ namespace MyCpp
 	inline T* lcallocate( uint flags, std::size_t size )
 	{
 		flags = ( flags & ~LMEM_MOVEABLE ) | LMEM_FIXED;
-		return malloc_func_adapter< T >( &::LocalAlloc, flags, size );
+		T* ptr = malloc_func_adapter< T >( &::LocalAlloc, flags, size );
+		MYCPP_TRACK_ALLOCATION( alloc_tag::local_memory, ::LocalSize( reinterpret_cast< HLOCAL >( ptr ) ) );
+		return ptr;
 	}
 
 	template < typename T >
 	inline T* glallocate( uint flags, std::size_t size )
 	{
 		flags = ( flags & ~GMEM_MOVEABLE ) | GMEM_FIXED;
-		return malloc_func_adapter< T >( &::GlobalAlloc, flags, size );
+		T* ptr = malloc_func_adapter< T >( &::GlobalAlloc, flags, size );
+		MYCPP_TRACK_ALLOCATION( alloc_tag::global_memory, ::GlobalSize( reinterpret_cast< HGLOBAL >( ptr ) ) );
+		return ptr;
 	}
 
 	template < typename T >
 	inline T* vtallocate( std::size_t size, dword allocationType, dword flagProtect, void* startAddr = null )
 	{
-		return malloc_func_adapter< T >( &::VirtualAlloc, startAddr, size, allocationType, flagProtect );
+		T* ptr = malloc_func_adapter< T >( &::VirtualAlloc, startAddr, size, allocationType, flagProtect );
+		MYCPP_TRACK_ALLOCATION( alloc_tag::virtual_memory, details::GetVirtualMemorySize( ptr ) );
+		return ptr;
 	}
 
 	template < typename T >
@@ -128,6 +159,7 @@ namespace MyCpp
 	{
 		details::heapmem_header* hdr = malloc_func_adapter< details::heapmem_header* >( &::HeapAlloc, hheap, flags, sizeof( details::heapmem_header ) + size );
 		hdr->hHeap = hheap;
+		MYCPP_TRACK_ALLOCATION( alloc_tag::heap_memory, ::HeapSize( hheap, 0, hdr ) );
 		return reinterpret_cast< T* >( hdr->data );
 	}
 
@@ -303,13 +335,17 @@ namespace MyCpp
 	inline memhandle_t lchallocate( uint flags, std::size_t size )
 	{
 		flags = ( flags & ~LMEM_FIXED ) | LMEM_MOVEABLE;
-		return malloc_handle_func_adapter( &::LocalAlloc, flags, size );
+		memhandle_t handle = malloc_handle_func_adapter( &::LocalAlloc, flags, size );
+		MYCPP_TRACK_ALLOCATION( alloc_tag::local_memory, ::LocalSize( handle ) );
+		return handle;
 	}
 
 	inline memhandle_t glhallocate( uint flags, std::size_t size )
 	{
 		flags = ( flags & ~GMEM_FIXED ) | GMEM_MOVEABLE;
-		return malloc_handle_func_adapter( &::LocalAlloc, flags, size );
+		memhandle_t handle = malloc_handle_func_adapter( &::GlobalAlloc, flags, size );
+		MYCPP_TRACK_ALLOCATION( alloc_tag::global_memory, ::GlobalSize( handle ) );
+		return handle;
 	}
 
 	typedef
@@ -350,12 +386,12 @@ namespace MyCpp
 
 	inline scoped_global_memory_handle make_scoped_global_memory_handle( dword flags, std::size_t size )
 	{
-		return scoped_global_memory_handle( lchallocate( flags, size ) );
+		return scoped_global_memory_handle( glhallocate( flags, size ) );
 	}
 
 	inline shared_global_memory_handle make_shared_global_memory_handle( dword flags, std::size_t size )
 	{
-		return { lchallocate( flags, size ), global_memory_deleter< typename std::remove_pointer< memhandle_t >::type >() };
+		return { glhallocate( flags, size ), global_memory_deleter< typename std::remove_pointer< memhandle_t >::type >() };
 	}
 
 	inline memlocker< memlock_traits< HGLOBAL_T > > make_scoped_global_memory_lock( const scoped_global_memory_handle& mem )
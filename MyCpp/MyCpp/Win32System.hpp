@@ -3,10 +3,22 @@
 #ifndef __MYCPP_WIN32SYSTEM_HPP__
 #define __MYCPP_WIN32SYSTEM_HPP__
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <shared_mutex>
+#include <unordered_map>
 #include "MyCpp/StringUtils.hpp"
 #include "MyCpp/Win32SafeHandle.hpp"
 #include "MyCpp/Win32Memory.hpp"
+#include "MyCpp/SmallVector.hpp"
+#include "MyCpp/LockProfiling.hpp"
 
 namespace MyCpp
 {
@@ -42,18 +54,21 @@ namespace MyCpp
 
 	namespace details
 	{
-		struct CriticalSectionExit
+		struct CriticalSectionExit : lock_hold
 		{
 			typedef CRITICAL_SECTION* pointer;
 
 			void operator () ( pointer p )
 			{
 				if ( p != null )
+				{
+					release_hold();
 					::LeaveCriticalSection( p );
+				}
 			}
 		};
 
-		struct MutexDeleter
+		struct MutexDeleter : lock_hold
 		{
 			typedef handle_t pointer;
 
@@ -61,6 +76,7 @@ namespace MyCpp
 			{
 				if ( p != null )
 				{
+					release_hold();
 					::ReleaseMutex( p );
 					::CloseHandle( p );
 				}
@@ -71,14 +87,371 @@ namespace MyCpp
 	typedef scoped_handle_t< HANDLE, details::MutexDeleter > mutex_t;
 	typedef std::unique_ptr< CRITICAL_SECTION, details::CriticalSectionExit > cslock_t;
 
-	std::pair< dword, mutex_t > TryLockMutex( const string_t& name, bool waitForGetOwnership );
-	cslock_t TryLockCriticalSection( CRITICAL_SECTION& csObj );
+	// Pass MYCPP_LOCK_SITE as site to attribute the acquisition when MYCPP_LOCK_PROFILING is defined.
+	std::pair< dword, mutex_t > TryLockMutex( const string_t& name, bool waitForGetOwnership, const lock_site& site = {} );
+	cslock_t TryLockCriticalSection( CRITICAL_SECTION& csObj, const lock_site& site = {} );
 
-	inline cslock_t TryLockCriticalSection( csptr_t& csObj )
+	inline cslock_t TryLockCriticalSection( csptr_t& csObj, const lock_site& site = {} )
 	{
-		return TryLockCriticalSection( *csObj );
+		return TryLockCriticalSection( *csObj, site );
 	}
 
+	// A 4 byte mutex. A contended lock() spins with exponential backoff for a short while,
+	// then parks the thread with WaitOnAddress(). unlock() wakes a thread only if one is parked.
+	// It needs no initialization call and no heap, and meets the Lockable requirements,
+	// so std::lock_guard and std::unique_lock work with it.
+	class fast_mutex
+	{
+	public:
+		constexpr fast_mutex() noexcept = default;
+
+		fast_mutex( const fast_mutex& ) = delete;
+		fast_mutex& operator = ( const fast_mutex& ) = delete;
+
+		void lock() noexcept
+		{
+			ulong expected = UNLOCKED;
+
+			if ( !m_state.compare_exchange_strong( expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed ) )
+				lock_contended();
+		}
+
+		// Never blocks.
+		bool try_lock() noexcept
+		{
+			ulong expected = UNLOCKED;
+			return m_state.compare_exchange_strong( expected, LOCKED, std::memory_order_acquire, std::memory_order_relaxed );
+		}
+
+		void unlock() noexcept
+		{
+			if ( m_state.exchange( UNLOCKED, std::memory_order_release ) == CONTENDED )
+				wake_one();
+		}
+	private:
+		static constexpr ulong UNLOCKED = 0;
+		static constexpr ulong LOCKED = 1;
+		static constexpr ulong CONTENDED = 2;		// locked, and a thread may be parked
+
+		void lock_contended() noexcept;
+		void wake_one() noexcept;
+
+		std::atomic< ulong > m_state = UNLOCKED;
+	};
+
+	namespace details
+	{
+		struct FastMutexExit
+		{
+			void operator () ( fast_mutex* p )
+			{
+				if ( p != null )
+					p->unlock();
+			}
+		};
+	}
+
+	typedef std::unique_ptr< fast_mutex, details::FastMutexExit > fmlock_t;
+
+	inline fmlock_t LockFastMutex( fast_mutex& m )
+	{
+		m.lock();
+		return fmlock_t( &m );
+	}
+
+	// Returns an empty lock if the mutex is held by another thread.
+	inline fmlock_t TryLockFastMutex( fast_mutex& m )
+	{
+		return fmlock_t( ( m.try_lock() ) ? &m : null );
+	}
+
+	// A 4 byte writer-preferring reader-writer lock.
+	// Readers share the lock. While a writer holds it or waits for it, new readers wait,
+	// so a steady stream of readers cannot starve writers.
+	// It meets the SharedLockable requirements, so std::shared_lock works with it too.
+	class rw_mutex
+	{
+	public:
+		constexpr rw_mutex() noexcept = default;
+
+		rw_mutex( const rw_mutex& ) = delete;
+		rw_mutex& operator = ( const rw_mutex& ) = delete;
+
+		void lock() noexcept;
+		void unlock() noexcept;
+
+		// Never blocks.
+		bool try_lock() noexcept
+		{
+			ulong expected = 0;
+			return m_state.compare_exchange_strong( expected, WRITER, std::memory_order_acquire, std::memory_order_relaxed );
+		}
+
+		void lock_shared() noexcept
+		{
+			ulong state = m_state.load( std::memory_order_relaxed );
+
+			if ( ( state & ( WRITER | WAITING_WRITERS ) ) != 0 || ( state & READERS ) == READERS ||
+				!m_state.compare_exchange_weak( state, state + 1, std::memory_order_acquire, std::memory_order_relaxed ) )
+				lock_shared_contended();
+		}
+
+		void unlock_shared() noexcept;
+
+		// Never blocks.
+		bool try_lock_shared() noexcept
+		{
+			ulong state = m_state.load( std::memory_order_relaxed );
+
+			while ( ( state & ( WRITER | WAITING_WRITERS ) ) == 0 && ( state & READERS ) != READERS )
+			{
+				if ( m_state.compare_exchange_weak( state, state + 1, std::memory_order_acquire, std::memory_order_relaxed ) )
+					return true;
+			}
+
+			return false;
+		}
+	private:
+		static constexpr ulong READERS = 0x0000ffff;		// reader count
+		static constexpr ulong WAITING_WRITER = 0x00010000;	// one unit of the waiting writer count
+		static constexpr ulong WAITING_WRITERS = 0x7fff0000;
+		static constexpr ulong WRITER = 0x80000000;
+
+		void lock_shared_contended() noexcept;
+
+		std::atomic< ulong > m_state = 0;
+	};
+
+	namespace details
+	{
+		struct ReadLockExit
+		{
+			void operator () ( rw_mutex* p )
+			{
+				if ( p != null )
+					p->unlock_shared();
+			}
+		};
+
+		struct WriteLockExit
+		{
+			void operator () ( rw_mutex* p )
+			{
+				if ( p != null )
+					p->unlock();
+			}
+		};
+	}
+
+	typedef std::unique_ptr< rw_mutex, details::ReadLockExit > readlock_t;
+	typedef std::unique_ptr< rw_mutex, details::WriteLockExit > writelock_t;
+
+	inline readlock_t LockForRead( rw_mutex& m )
+	{
+		m.lock_shared();
+		return readlock_t( &m );
+	}
+
+	inline writelock_t LockForWrite( rw_mutex& m )
+	{
+		m.lock();
+		return writelock_t( &m );
+	}
+
+	// Returns an empty lock if a writer holds or waits for the lock.
+	inline readlock_t TryLockForRead( rw_mutex& m )
+	{
+		return readlock_t( ( m.try_lock_shared() ) ? &m : null );
+	}
+
+	// Returns an empty lock if the lock is held by anyone.
+	inline writelock_t TryLockForWrite( rw_mutex& m )
+	{
+		return writelock_t( ( m.try_lock() ) ? &m : null );
+	}
+
+	// A sequence lock for a small trivially copyable value that is read far more often than written.
+	// Readers never write to shared memory; they copy the value and retry if a writer ran meanwhile.
+	// Writers are serialized by a fast_mutex and never wait for readers.
+	template < typename T >
+	class seqlock
+	{
+		static_assert( std::is_trivially_copyable_v< T >, "seqlock requires a trivially copyable type." );
+	public:
+		typedef T value_type;
+
+		seqlock() noexcept
+			: seqlock( T() )
+		{
+		}
+
+		explicit seqlock( const T& value ) noexcept
+		{
+			store( value );
+		}
+
+		seqlock( const seqlock& ) = delete;
+		seqlock& operator = ( const seqlock& ) = delete;
+
+		T read() const noexcept
+		{
+			T value;
+
+			while ( !try_read( value ) )
+				YieldProcessor();
+
+			return value;
+		}
+
+		// Makes a single attempt. Returns false if a writer was active.
+		bool try_read( T& value ) const noexcept
+		{
+			ulong before = m_sequence.load( std::memory_order_acquire );
+
+			if ( ( before & 1 ) != 0 )
+				return false;
+
+			word_t words[WORDS];
+
+			for ( std::size_t i = 0; i < WORDS; ++i )
+				words[i] = m_words[i].load( std::memory_order_relaxed );
+
+			std::atomic_thread_fence( std::memory_order_acquire );
+
+			if ( m_sequence.load( std::memory_order_relaxed ) != before )
+				return false;
+
+			std::memcpy( &value, words, sizeof( T ) );
+			return true;
+		}
+
+		void write( const T& value ) noexcept
+		{
+			fmlock_t lock = LockFastMutex( m_writer );
+			store( value );
+		}
+
+		// Calls f( T& ) on the current value under the writer lock, then publishes the result.
+		template < typename F >
+		void update( F&& f )
+		{
+			fmlock_t lock = LockFastMutex( m_writer );
+			T value = load();
+			f( value );
+			store( value );
+		}
+	private:
+		typedef std::size_t word_t;
+		static constexpr std::size_t WORDS = ( sizeof( T ) + sizeof( word_t ) - 1 ) / sizeof( word_t );
+
+		// The caller holds m_writer, so no other thread changes the words.
+		T load() const noexcept
+		{
+			word_t words[WORDS];
+
+			for ( std::size_t i = 0; i < WORDS; ++i )
+				words[i] = m_words[i].load( std::memory_order_relaxed );
+
+			T value;
+			std::memcpy( &value, words, sizeof( T ) );
+			return value;
+		}
+
+		void store( const T& value ) noexcept
+		{
+			word_t words[WORDS] = {};
+			std::memcpy( words, &value, sizeof( T ) );
+
+			ulong sequence = m_sequence.load( std::memory_order_relaxed );
+			m_sequence.store( sequence + 1, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_release );
+
+			for ( std::size_t i = 0; i < WORDS; ++i )
+				m_words[i].store( words[i], std::memory_order_relaxed );
+
+			m_sequence.store( sequence + 2, std::memory_order_release );
+		}
+
+		std::atomic< ulong > m_sequence = 0;
+		std::atomic< word_t > m_words[WORDS] = {};
+		fast_mutex m_writer;
+	};
+
+	namespace details
+	{
+		struct ViewUnmapper
+		{
+			void operator () ( void* p )
+			{
+				if ( p != null )
+					::UnmapViewOfFile( p );
+			}
+		};
+	}
+
+	// A mutex shared between processes by name.
+	// The lock word lives in a named file mapping, so an uncontended lock() and unlock()
+	// never enter the kernel. A named event is used only to park and wake waiters.
+	// If the owning process dies while holding the lock, the next lock() takes it over
+	// and reports that, as WAIT_ABANDONED does for Win32 mutexes.
+	// The lock is owned by the process, not by a thread, and is not recursive.
+	class interprocess_mutex
+	{
+	public:
+		explicit interprocess_mutex( const string_t& name );
+
+		interprocess_mutex( const interprocess_mutex& ) = delete;
+		interprocess_mutex& operator = ( const interprocess_mutex& ) = delete;
+
+		// Returns true if the previous owner died while holding the lock.
+		// The state the lock protects may then be inconsistent.
+		bool lock();
+
+		// Never waits for a live owner, but takes the lock over from a dead one.
+		bool try_lock();
+
+		void unlock() noexcept;
+
+		// Returns ERROR_SUCCESS when the lock is owned, ERROR_ABANDONED_WAIT_0 when it was taken over
+		// from a dead owner, or ERROR_ALREADY_EXISTS when another owner holds it and wait is false.
+		dword acquire( bool wait );
+	private:
+		struct shared_block;
+
+		bool is_owner_dead( qword state, qword ownerCreationTime, scoped_generic_handle& ownerProcess ) const;
+		void publish_owner() noexcept;
+
+		scoped_generic_handle m_mapping;
+		std::unique_ptr< void, details::ViewUnmapper > m_view;
+		shared_block* m_block = null;
+		scoped_generic_handle m_wake;
+		dword m_pid = 0;
+		qword m_creationTime = 0;
+	};
+
+	namespace details
+	{
+		struct InterprocessMutexExit
+		{
+			void operator () ( interprocess_mutex* p )
+			{
+				if ( p != null )
+				{
+					p->unlock();
+					delete p;
+				}
+			}
+		};
+	}
+
+	typedef std::unique_ptr< interprocess_mutex, details::InterprocessMutexExit > ipmutex_t;
+
+	// The shared memory counterpart of TryLockMutex(). The first value is
+	//   ERROR_SUCCESS           the lock is owned.
+	//   ERROR_ALREADY_EXISTS    another owner holds it and waitForGetOwnership is false. The second value is empty.
+	//   ERROR_ABANDONED_WAIT_0  the previous owner died while holding it, and the lock is now owned.
+	std::pair< dword, ipmutex_t > TryLockInterprocessMutex( const string_t& name, bool waitForGetOwnership );
+
 	template 
 	<
 		typename T,
@@ -91,6 +464,14 @@ namespace MyCpp
 		return Size;
 	}
 
+	namespace details
+	{
+		// Temporary buffers of the library. N elements are kept inline,
+		// and heap spills are reported under alloc_tag::system_buffer.
+		template < typename T, std::size_t N >
+		using system_buffer = small_vector< T, N, alloc_tag::system_buffer >;
+	}
+
 	template < typename Vector, typename Source >
 	inline std::size_t adaptive_load( Vector& v, std::size_t initn, Source source )
 	{
@@ -105,12 +486,101 @@ namespace MyCpp
 			if ( result == 0 || result < v.size() )
 				break;
 
-			v.resize( v.size() * 2 );
+			// A source may answer with the required size instead of a truncated one.
+			v.resize( std::max< std::size_t >( v.size() * 2, result ) );
 		}
 
 		return result;
 	}
 
+	struct adaptive_load_stats
+	{
+		const char_t* name;
+		std::size_t calls;		// adaptive_load() calls
+		std::size_t loads;		// source calls. ( loads - calls ) are retries.
+		std::size_t size;		// the learned initial size
+	};
+
+	// Remembers the buffer size that the last successful adaptive_load() call of one call site needed,
+	// so the next call starts from it and usually calls the source once.
+	// A named hint registers itself for GetAdaptiveLoadStatistics(), so it must outlive the program;
+	// use a static object for it.
+	class adaptive_load_hint
+	{
+	public:
+		explicit adaptive_load_hint( const char_t* name = null ) noexcept;
+
+		adaptive_load_hint( const adaptive_load_hint& ) = delete;
+		adaptive_load_hint& operator = ( const adaptive_load_hint& ) = delete;
+
+		std::size_t size() const noexcept
+		{
+			return m_size.load( std::memory_order_relaxed );
+		}
+
+		// size is what the last successful load needed, so one large result does not
+		// keep every later call on a heap-sized buffer. size == 0 ( a failed load ) is not learned.
+		void update( std::size_t size, std::size_t loads ) noexcept
+		{
+			if ( size != 0 )
+				m_size.store( size, std::memory_order_relaxed );
+
+			m_calls.fetch_add( 1, std::memory_order_relaxed );
+			m_loads.fetch_add( loads, std::memory_order_relaxed );
+		}
+
+		adaptive_load_stats stats() const noexcept
+		{
+			return
+			{
+				m_name,
+				m_calls.load( std::memory_order_relaxed ),
+				m_loads.load( std::memory_order_relaxed ),
+				m_size.load( std::memory_order_relaxed )
+			};
+		}
+
+		const adaptive_load_hint* next() const noexcept
+		{
+			return m_next;
+		}
+	private:
+		const char_t* m_name;
+		std::atomic< std::size_t > m_size = 0;
+		std::atomic< std::size_t > m_calls = 0;
+		std::atomic< std::size_t > m_loads = 0;
+		adaptive_load_hint* m_next = null;
+	};
+
+	std::vector< adaptive_load_stats > GetAdaptiveLoadStatistics();
+
+	template < typename Vector, typename Source >
+	inline std::size_t adaptive_load( Vector& v, std::size_t initn, adaptive_load_hint& hint, Source source )
+	{
+		std::size_t n = std::max( initn, hint.size() );
+
+		if ( v.size() < n )
+			v.resize( n );
+
+		std::size_t result = 0;
+		std::size_t loads = 0;
+
+		while ( true )
+		{
+			result = source( v.data(), v.size() );
+			++loads;
+
+			if ( result == 0 || result < v.size() )
+				break;
+
+			v.resize( std::max< std::size_t >( v.size() * 2, result ) );
+		}
+
+		hint.update( ( result != 0 ) ? result + 1 : 0, loads );
+
+		return result;
+	}
+
 	path_t GetCurrentLocation();
 	path_t GetSpecialFolderLocation( const guid_t& folderId );
 	path_t GetTemporaryPath();
@@ -166,10 +636,73 @@ namespace MyCpp
 	path_t GetProgramModuleFileName( module_handle_t hmodule = null );
 	path_t GetProgramModuleFileLocation( module_handle_t hmodule = null );
 
+	// One entry of the process list. exeFile is valid only during the callback.
+	struct process_entry
+	{
+		dword pid;
+		dword parentPid;
+		dword threads;
+		const char_t* exeFile;
+	};
+
+	typedef bool ( *process_entry_callback )( const process_entry& entry, void* context );
+
+	// Walks the process list without opening the processes.
+	// The walk stops when callback returns false. Returns false if the list cannot be taken.
+	bool EnumProcessEntries( process_entry_callback callback, void* context );
+
+	template < typename Func >
+	inline bool ForEachProcessEntry( Func&& func )
+	{
+		return EnumProcessEntries(
+			[] ( const process_entry& entry, void* context )
+		{
+			return static_cast< bool >( ( *static_cast< std::remove_reference_t< Func >* >( context ) )( entry ) );
+		}, const_cast< void* >( static_cast< const void* >( std::addressof( func ) ) ) );
+	}
+
 	class Process
 	{
 	public:
-		class Data;
+		// Owns the process and thread handles, and caches the image names queried on first use.
+		// It is kept inside Process, so std::make_shared< Process >() makes one allocation
+		// for the object, its data and the reference count.
+		// A copy duplicates the handles, so a copied Process stays valid after the original is destroyed.
+		class Data
+		{
+		public:
+			typedef PROCESS_INFORMATION ProcessInformation;
+
+			Data() = default;
+			Data( Data&& right ) noexcept;
+			Data( const Data& right );
+			Data( const ProcessInformation& info );
+
+			// Replaces the process and its names, so the names may go back to not loaded.
+			// Like any non-const call, it must not run while another thread uses this object.
+			Data& operator = ( Data right ) noexcept;
+
+			~Data();
+
+			const ProcessInformation& GetProcessData() const;
+
+			// Empty while the names cannot be queried.
+			const path_t& GetProcessFileName() const;
+			const string_t& GetProcessBaseName() const;
+
+			// Queries the names now, if it has not been done yet. A failed query is tried again on the next call.
+			// Returns false if the names cannot be queried.
+			bool LoadNames() const;
+		private:
+			bool QueryNames() const;
+			void Close() noexcept;
+
+			ProcessInformation m_process = {};
+			mutable std::atomic< bool > m_namesReady = false;	// published with release after the names are written; only assignment resets it
+			mutable fast_mutex m_namesLock;
+			mutable path_t m_fileName;
+			mutable string_t m_baseName;
+		};
 
 		typedef typename std::remove_pointer< PSID >::type SID;
 
@@ -188,19 +721,40 @@ namespace MyCpp
 		dword GetId() const;
 		dword GetPrimaryThreadId() const;
 		dword GetExitCode() const;
+		qword GetCreationTime() const;	// FILETIME as a 64bit value. 0 if it cannot be queried.
 		PtrSID GetSid() const;
 		Ptr GetParent() const;
 
 		static Process* GetCurrent();
+
+		// Queries the names of all processes in one pass, so later GetName()/GetFileName() calls only read them.
+		static void PrefetchNames( const Ptr* processes, std::size_t count );
+
+		static void PrefetchNames( const std::vector< Ptr >& processes )
+		{
+			PrefetchNames( processes.data(), processes.size() );
+		}
 		static Ptr Create( const string_t& cmdline, const path_t& appCurrentDir = null, void* envVariables = null, int creationFlags = 0, bool inheritHandle = false, int cmdShow = SW_SHOWDEFAULT );
 
+		// Read ends of the pipes the child writes its output to.
+		// They are opened for overlapped I/O, so they can be given to output_reactor.
+		struct OutputPipes
+		{
+			scoped_generic_handle stdOut;
+			scoped_generic_handle stdErr;	// not opened when stderr is merged into stdout
+		};
+
+		// Same as Create(), but stdout and stderr of the child go to pipes returned in pipes,
+		// and stdin reads the NUL device. The child inherits only these handles.
+		static Ptr Create( const string_t& cmdline, OutputPipes& pipes, bool mergeStdErr = false, const path_t& appCurrentDir = null, void* envVariables = null, int creationFlags = 0, int cmdShow = SW_HIDE );
+
 		void Terminate( int exitCode );
 		void Suspend();
 		void Resume();
 
 		dword Wait( dword milliseconds = INFINITE, bool forInputIdle = false ) const;
 	private:
-		std::shared_ptr< Data > m_data;
+		Data m_data;
 	};
 
 	typedef MyCpp::Process::Ptr processptr_t;
@@ -265,11 +819,372 @@ namespace MyCpp
 
 	wndptr_t FindProcessWindow( const processptr_t& process, const string_t& wndClassName, const string_t& wndName );
 
+	// Returns null unless pid belongs to a running process.
 	processptr_t GetProcess( dword pid );
+	// Same, but also null if the process was not created at creationTime ( see Process::GetCreationTime() ),
+	// which detects a reused pid.
+	processptr_t GetProcess( dword pid, qword creationTime );
+	// Enumerates the processes once for all pids. The result has count entries, null for the missing ones.
+	std::vector< processptr_t > GetProcesses( const dword* pids, std::size_t count );
+
+	inline std::vector< processptr_t > GetProcesses( const std::vector< dword >& pids )
+	{
+		return GetProcesses( pids.data(), pids.size() );
+	}
+
 	processptr_t GetProcess( handle_t hProcess );
+
+	// Suspends or resumes the threads of all given processes, taking one thread snapshot for all of them.
+	// The calling thread is never suspended. Returns the number of threads whose suspend count was changed.
+	std::size_t SuspendProcesses( const dword* pids, std::size_t count, bool suspend );
+	std::size_t SuspendProcesses( const std::vector< processptr_t >& processes, bool suspend );
 	processptr_t OpenProcessByFileName( const path_t& fileName, bool inheritHandle = false, dword accessMode = 0 );
+	// Opens all processes of fileName. A full path is matched by querying every process,
+	// which runs on thread_pool::shared() with at most threads threads, counting the calling one.
+	// threads == 0 uses the whole pool, and threads == 1 scans on the calling thread.
+	std::vector< processptr_t > OpenProcessesByFileName( const path_t& fileName, bool inheritHandle = false, dword accessMode = 0, std::size_t threads = 0 );
 	processptr_t OpenCuProcessByFileName( const path_t& fileName, bool inheritHandle = false, dword accessMode = 0 );
 
+	// An index of the running processes by pid, image file name and full path.
+	// Names and paths are compared case-insensitively.
+	// refresh() compares the process list by pid, parent pid and image name, and opens only
+	// the processes that appeared or changed since the previous refresh, so keeping one snapshot
+	// and refreshing it is much cheaper than repeated OpenProcessByFileName() calls.
+	// A pid reused by a process of the same parent and image is caught by open(), which compares the creation time.
+	// All members may be called from any thread.
+	class process_snapshot
+	{
+	public:
+		struct entry
+		{
+			dword pid;
+			dword parentPid;
+			string_t name;		// image file name. e.g. "notepad.exe"
+			path_t path;		// full path. empty if the process could not be queried.
+			qword creationTime;		// 0 if the process could not be queried
+		};
+
+		typedef std::shared_ptr< const entry > entryptr_t;
+
+		// Takes the first snapshot.
+		process_snapshot();
+
+		process_snapshot( const process_snapshot& ) = delete;
+		process_snapshot& operator = ( const process_snapshot& ) = delete;
+
+		void refresh();
+		std::size_t size() const;
+
+		entryptr_t find( dword pid ) const;
+		entryptr_t find_by_name( const string_t& fileName ) const;
+		entryptr_t find_by_path( const path_t& fullPath ) const;
+		std::vector< entryptr_t > find_all_by_name( const string_t& fileName ) const;
+		std::vector< entryptr_t > find_all_by_path( const path_t& fullPath ) const;
+
+		// Same as OpenProcessByFileName(), but matches against the snapshot.
+		processptr_t open( const path_t& fileName, bool inheritHandle = false, dword accessMode = 0 ) const;
+	private:
+		// Keys are folded to upper case, as the file system compares names.
+		typedef std::unordered_multimap< string_t, entryptr_t > index_t;
+
+		static string_t key( string_t s );
+		static void erase( index_t& index, const string_t& k, const entryptr_t& e );
+		static std::vector< entryptr_t > find_all( const index_t& index, const string_t& k );
+
+		mutable std::shared_mutex m_lock;
+		std::mutex m_refreshLock;
+		std::unordered_map< dword, entryptr_t > m_byPid;
+		index_t m_byName;
+		index_t m_byPath;
+	};
+
+	// The parent/child relation of the processes, built from one pass over the process list.
+	// Each process gets a slot; parent and children are kept in flat arrays indexed by slot,
+	// so every hop is O(1). Like any snapshot, it does not follow processes started later.
+	// A process is linked to its parent pid only if that process was created before it,
+	// so a process that took over the pid of an exited parent is not counted as the parent.
+	class process_tree
+	{
+	public:
+		static constexpr dword invalid_pid = static_cast< dword >( -1 );
+
+		// Takes the snapshot.
+		process_tree();
+
+		std::size_t size() const noexcept
+		{
+			return m_pids.size();
+		}
+
+		bool contains( dword pid ) const
+		{
+			return ( slot_of( pid ) != npos );
+		}
+
+		// Returns null if pid is not in the tree.
+		const char_t* name( dword pid ) const;
+
+		// Returns invalid_pid for roots and for processes whose parent has exited.
+		dword parent( dword pid ) const;
+
+		std::vector< dword > children( dword pid ) const;
+
+		// Nearest first.
+		std::vector< dword > ancestors( dword pid ) const;
+
+		// Pre-order, pid itself is not included.
+		std::vector< dword > descendants( dword pid ) const;
+
+		// Visits pid and its descendants in pre-order as func( pid, depth ).
+		// Children of a process are skipped when func returns false for it.
+		template < typename Func >
+		void walk_subtree( dword pid, Func&& func ) const
+		{
+			std::size_t root = slot_of( pid );
+
+			if ( root == npos )
+				return;
+
+			std::vector< std::pair< std::size_t, std::size_t > > stack;
+			stack.emplace_back( root, 0 );
+
+			while ( !stack.empty() )
+			{
+				auto [slot, depth] = stack.back();
+				stack.pop_back();
+
+				if ( !func( m_pids[slot], depth ) )
+					continue;
+
+				// Pushed in reverse, so children are visited in list order.
+				for ( std::size_t i = m_childBegin[slot + 1]; i > m_childBegin[slot]; --i )
+					stack.emplace_back( m_children[i - 1], depth + 1 );
+			}
+		}
+	private:
+		static constexpr std::size_t npos = static_cast< std::size_t >( -1 );
+
+		std::size_t slot_of( dword pid ) const;
+
+		std::vector< dword > m_pids;				// slot -> pid
+		std::vector< string_t > m_names;			// slot -> image file name
+		std::vector< std::size_t > m_parents;		// slot -> parent slot or npos
+		std::vector< std::size_t > m_childBegin;	// slot -> first index in m_children. size() + 1 entries.
+		std::vector< std::size_t > m_children;		// child slots, grouped by parent
+		std::unordered_map< dword, std::size_t > m_slots;	// pid -> slot
+	};
+
+	// Reports the exits of many processes as they happen.
+	// Each process is waited for by the system thread pool ( RegisterWaitForSingleObject() ),
+	// so no thread is blocked per process and nothing is polled.
+	// Exits are queued for wait_any(), or passed to the callback if one is set.
+	class process_waiter
+	{
+	public:
+		typedef std::function< void( const processptr_t& process ) > callback_t;
+
+		process_waiter() = default;
+
+		// Stops all waits. Returns after running callbacks have finished.
+		~process_waiter();
+
+		process_waiter( const process_waiter& ) = delete;
+		process_waiter& operator = ( const process_waiter& ) = delete;
+
+		// The process object is kept until its exit is reported or it is removed.
+		void add( const processptr_t& process );
+
+		// Returns false if the process is not waited for, or its exit has already been reported.
+		bool remove( const processptr_t& process );
+
+		// The number of processes that are still waited for.
+		std::size_t pending() const;
+
+		// Takes the next exited process. Returns null on timeout,
+		// or at once if no exit is queued and no process is waited for.
+		processptr_t wait_any( dword milliseconds = INFINITE );
+
+		// Returns true when no process is waited for any more.
+		bool wait_all( dword milliseconds = INFINITE );
+
+		// Called on a thread pool thread for each exit. While a callback is set, exits are not queued.
+		void set_callback( callback_t callback );
+	private:
+		struct registration;
+
+		static void CALLBACK OnExit( void* context, BOOLEAN timedOut );
+
+		template < typename Predicate >
+		bool wait_for( std::unique_lock< std::mutex >& lock, dword milliseconds, Predicate predicate );
+
+		mutable std::mutex m_lock;
+		std::condition_variable m_changed;
+		std::unordered_map< registration*, std::unique_ptr< registration > > m_registrations;
+		std::deque< processptr_t > m_exited;
+		std::shared_ptr< callback_t > m_callback;
+		std::size_t m_running = 0;		// callbacks between taking their registration and returning
+	};
+
+	// Drains many pipes in parallel through one I/O completion port.
+	// Each pipe is read directly into a buffer owned by the caller, and the sink gets the bytes in place.
+	// A pipe has one read outstanding at a time, and the next one is issued after its sink returns,
+	// so a slow sink leaves the pipe full and the writer blocks ( backpressure ) instead of data piling up here.
+	class output_reactor
+	{
+	public:
+		// size is 0 once, at the end of the stream. data is valid only during the call.
+		typedef std::function< void( const byte* data, std::size_t size ) > sink_t;
+
+		// threads == 0 starts one worker per hardware thread.
+		explicit output_reactor( std::size_t threads = 1 );
+
+		// Cancels the reads that are still pending. Their sinks get the end of the stream.
+		~output_reactor();
+
+		output_reactor( const output_reactor& ) = delete;
+		output_reactor& operator = ( const output_reactor& ) = delete;
+
+		// pipe must have been opened for overlapped I/O, e.g. by Process::Create( ..., OutputPipes&, ... ).
+		// buffer must stay valid until the sink has got the end of the stream.
+		void add( scoped_generic_handle pipe, byte* buffer, std::size_t size, sink_t sink );
+
+		// The number of streams that have not ended.
+		std::size_t active() const;
+
+		// Returns true when all streams have ended.
+		bool wait( dword milliseconds = INFINITE );
+	private:
+		struct stream;
+
+		void run();
+		bool read( stream* s );
+		void finish( stream* s );
+
+		handle_t m_port = null;
+		std::vector< std::thread > m_workers;
+		mutable std::mutex m_lock;
+		std::condition_variable m_changed;
+		std::unordered_map< stream*, std::unique_ptr< stream > > m_streams;
+		std::atomic< bool > m_stopping = false;		// set by the destructor; no read is issued after it
+		std::atomic< std::size_t > m_issuing = 0;		// read() calls between checking m_stopping and issuing their read
+	};
+
+	struct process_pool_worker_stats
+	{
+		dword pid;				// 0 while the worker is not running
+		std::size_t jobs;		// jobs completed by this slot
+		std::size_t failures;	// jobs lost to a failed or crashed worker
+		std::size_t restarts;	// worker processes started after the first one
+		double utilization;		// busy time / lifetime of the current worker process. 0 to 1.
+	};
+
+	// Keeps warm worker processes started from one command line and hands jobs to them over pipes.
+	// A worker reads requests from stdin and writes one reply to stdout for each, in order.
+	// Each message is a 32bit little-endian byte count followed by that many bytes.
+	// A worker should exit when stdin ends. Its stderr goes to the NUL device.
+	// A worker is replaced after maxJobsPerWorker jobs ( 0: never ), when a job fails on it,
+	// or when it exits by itself; exits are detected by a process_waiter.
+	// A job that gets no reply within jobTimeout milliseconds fails, and its worker is terminated and replaced.
+	// With INFINITE, a worker that hangs without exiting blocks its slot, and the destructor, for good.
+	class process_pool
+	{
+	public:
+		typedef std::vector< byte > message_t;
+
+		process_pool( const string_t& cmdline, std::size_t workers, std::size_t maxJobsPerWorker = 0, dword jobTimeout = 60000 );
+
+		// Jobs still in the queue are abandoned; their futures throw std::future_error ( broken_promise ).
+		// A running job is finished first, which takes at most jobTimeout.
+		~process_pool();
+
+		process_pool( const process_pool& ) = delete;
+		process_pool& operator = ( const process_pool& ) = delete;
+
+		// The future throws std::runtime_error if the worker fails while running the job.
+		std::future< message_t > submit( message_t request );
+
+		// Jobs waiting for a worker.
+		std::size_t queue_depth() const;
+
+		std::vector< process_pool_worker_stats > stats() const;
+	private:
+		struct job;
+		struct slot;
+
+		void dispatch( slot& w );
+		void start( slot& w );
+		void stop( slot& w, bool force );
+
+		const string_t m_cmdline;
+		const std::size_t m_maxJobsPerWorker;
+		const dword m_jobTimeout;
+		mutable std::mutex m_lock;
+		std::condition_variable m_changed;
+		std::deque< job > m_queue;
+		std::vector< std::unique_ptr< slot > > m_slots;
+		bool m_stopping = false;
+		process_waiter m_waiter;	// destroyed first, so its callback never sees a destroyed pool
+	};
+
+	struct process_sample
+	{
+		std::chrono::steady_clock::time_point time;
+		qword kernelTime;		// 100ns units
+		qword userTime;			// 100ns units
+		std::size_t workingSet;	// bytes
+		std::size_t privateBytes;
+		dword pageFaults;
+		qword readBytes;
+		qword writeBytes;
+		qword otherBytes;		// I/O that is neither read nor write
+	};
+
+	// Samples CPU time, memory and I/O of a set of processes at a fixed interval on its own thread,
+	// and keeps the last history samples of each process in a ring buffer.
+	// The process handles stay open, and a sampling pass does not allocate.
+	// Intervals shorter than the system timer resolution ( usually 15.6ms ) are stretched to it,
+	// unless the application raises the resolution with timeBeginPeriod().
+	class process_stats
+	{
+	public:
+		explicit process_stats( std::chrono::milliseconds interval = std::chrono::milliseconds( 1000 ), std::size_t history = 600 );
+		~process_stats();
+
+		process_stats( const process_stats& ) = delete;
+		process_stats& operator = ( const process_stats& ) = delete;
+
+		// Adding a process that is already sampled does nothing.
+		void add( const processptr_t& process );
+		void remove( const processptr_t& process );
+
+		// The constructor and set_interval() throw std::invalid_argument for an interval that is not positive.
+		void set_interval( std::chrono::milliseconds interval );
+
+		// Takes one sample of every process now, besides the periodic ones.
+		void sample_now();
+
+		// Copies up to count of the newest samples of pid, oldest first, and returns how many were copied.
+		std::size_t samples( dword pid, process_sample* out, std::size_t count ) const;
+		std::vector< process_sample > samples( dword pid ) const;
+
+		bool latest( dword pid, process_sample& sample ) const;
+	private:
+		struct series;
+
+		void run();
+		void sample_all();
+
+		const std::size_t m_history;
+		std::chrono::milliseconds m_interval;
+		mutable std::mutex m_lock;
+		std::condition_variable m_changed;
+		std::vector< std::shared_ptr< series > > m_series;
+		std::mutex m_passLock;		// serializes sampling passes
+		std::vector< std::shared_ptr< series > > m_pass;		// the series of the running pass, guarded by m_passLock
+		bool m_stopping = false;
+		std::thread m_sampler;
+	};
+
 	int RunElevated( const path_t& file, const string_t& parameters = null, bool waitForExit = true, int cmdShow = SW_SHOWDEFAULT );
 
 	string_t GetIniString( const path_t& file, const string_t& section, const string_t& name, const string_t& defaultValue = null );
@@ -425,6 +1340,209 @@ namespace MyCpp
 	{
 		details::SetIniXword( file, section, name, value );
 	}
+
+	// An INI file read and parsed once, for looking up many keys.
+	// Every GetIni*() call makes the system open and scan the file again. ini_document reads it
+	// in one go into a single buffer and indexes every section and key in hash tables,
+	// so a lookup is one case-insensitive hash probe. The views it returns point into that buffer
+	// and stay valid until the document is loaded again or destroyed.
+	// The text is parsed as GetPrivateProfileString() parses it: UTF-16LE with a BOM, otherwise the ANSI code page
+	// ( a UTF-8 BOM is also accepted ), ';' starts a comment line, whitespace around names and values is dropped,
+	// a value quoted with a matching pair of ' or " loses the quotes, and the first of duplicate sections or keys wins.
+	// Changes made to the file later are not seen until load() is called again.
+	// A file name without a directory is looked for in the Windows directory, as the GetIni*() functions do;
+	// other relative paths are relative to the current directory.
+	class ini_document
+	{
+	public:
+		ini_document() = default;
+
+		// A file that does not exist gives an empty document, as it does for GetIniString().
+		explicit ini_document( const path_t& file );
+
+		// Returns false if the file could not be read. The document is then empty.
+		bool load( const path_t& file );
+
+		bool has_section( string_view_t section ) const;
+		bool contains( string_view_t section, string_view_t name ) const;
+
+		string_view_t get_string( string_view_t section, string_view_t name, string_view_t defaultValue = {} ) const;
+
+		// Decodes a value written by SetIniBinary(). Returns false if the key is missing,
+		// or the value does not hold size bytes and a valid checksum.
+		bool get_binary( string_view_t section, string_view_t name, void* ptr, uint size ) const;
+
+		template < typename Int >
+		Int get_int( string_view_t section, string_view_t name ) const
+		{
+			string_t value( get_string( section, name ) );
+
+			if constexpr ( std::is_unsigned_v< Int > )
+				return static_cast< Int >( std::stoull( value, null, 10 ) );
+			else
+				return static_cast< Int >( std::stoll( value, null, 10 ) );
+		}
+
+		template < typename Xword >
+		Xword get_xword( string_view_t section, string_view_t name ) const
+		{
+			static_assert( std::is_same_v< Xword, qword > || std::is_same_v< Xword, dword >, "get_xword requires qword or dword." );
+
+			string_t value( get_string( section, name ) );
+
+			if constexpr ( std::is_same_v< Xword, qword > )
+				return static_cast< qword >( std::stoull( value, null, 16 ) );
+			else
+				return static_cast< dword >( std::stoul( value, null, 16 ) );
+		}
+
+		template < typename FloatType >
+		FloatType get_float( string_view_t section, string_view_t name ) const
+		{
+			return static_cast< FloatType >( std::stod( string_t( get_string( section, name ) ) ) );
+		}
+
+		template
+		<
+			typename DataType,
+			std::enable_if_t< std::is_standard_layout_v< DataType > && std::is_trivial_v< DataType >, bool > = true
+		>
+		bool get_data( string_view_t section, string_view_t name, DataType& data ) const
+		{
+			return get_binary( section, name, &data, sizeof( DataType ) );
+		}
+
+		// In file order.
+		std::vector< string_view_t > sections() const;
+		std::vector< string_view_t > keys( string_view_t section ) const;
+	private:
+		struct entry
+		{
+			string_view_t name;
+			string_view_t value;
+		};
+
+		struct section_entry
+		{
+			string_view_t name;
+			std::vector< std::size_t > entries;
+		};
+
+		void parse( std::size_t length );
+		const entry* find( string_view_t section, string_view_t name ) const;
+
+		// Held by pointer, so that moving the document keeps the views valid.
+		std::unique_ptr< char_t[] > m_text;
+		std::unique_ptr< char_t[] > m_folded;		// the upper-cased "SECTION" and "SECTION\nKEY" strings the indexes point into
+		std::vector< entry > m_entries;
+		std::vector< section_entry > m_sections;
+		std::unordered_map< string_view_t, std::size_t > m_sectionIndex;
+		std::unordered_map< string_view_t, std::size_t > m_entryIndex;
+	};
+
+	// Collects INI edits in memory and writes them to the file at once.
+	// Each SetIni*() call makes the system rewrite the whole file, so writing many keys is quadratic in I/O,
+	// and a failure half way leaves some keys written and others not. commit() reads the file once,
+	// applies every edit, writes the result to a temporary file beside it, flushes that to disk
+	// and renames it over the original. Readers see either the old file or the new one.
+	// Lines that are not edited, comments included, are kept as they are and in their order.
+	// A changed key stays on its line, and a new key is added after the last key of its section.
+	// A new section is added at the end of the file. The file keeps its encoding ( see ini_document ).
+	// Edits to the same key replace each other, and names are compared case-insensitively.
+	// The transaction does not lock the file: writes made by others between commit() reading
+	// and replacing the file are lost. A file name without a directory names a file in the Windows directory,
+	// as it does for SetIni*(). It is resolved when the transaction is created.
+	class ini_transaction
+	{
+	public:
+		explicit ini_transaction( const path_t& file );
+
+		// Edits that were not committed are discarded.
+		~ini_transaction() = default;
+
+		ini_transaction( const ini_transaction& ) = delete;
+		ini_transaction& operator = ( const ini_transaction& ) = delete;
+
+		// Unlike SetIniString(), an empty value is written as "name=". Use remove_key() to delete a key.
+		void set_string( const string_t& section, const string_t& name, const string_t& value );
+
+		// Writes the format of SetIniBinary(), which GetIniBinary() and ini_document::get_binary() read.
+		void set_binary( const string_t& section, const string_t& name, const void* ptr, uint size );
+
+		template < typename Int >
+		void set_int( const string_t& section, const string_t& name, Int value )
+		{
+			if constexpr ( std::is_unsigned_v< Int > )
+				set_string( section, name, strprintf( _T( "%I64u" ), static_cast< std::uint64_t >( value ) ) );
+			else
+				set_string( section, name, strprintf( _T( "%I64d" ), static_cast< std::int64_t >( value ) ) );
+		}
+
+		void set_xword( const string_t& section, const string_t& name, qword value )
+		{
+			set_string( section, name, strprintf( _T( "0x%016llX" ), value ) );
+		}
+
+		void set_xword( const string_t& section, const string_t& name, dword value )
+		{
+			set_string( section, name, strprintf( _T( "0x%08lX" ), value ) );
+		}
+
+		template < typename FloatType >
+		void set_float( const string_t& section, const string_t& name, FloatType value )
+		{
+			set_string( section, name, strprintf( _T( "%lf" ), static_cast< double >( value ) ) );
+		}
+
+		template
+		<
+			typename DataType,
+			std::enable_if_t< std::is_standard_layout_v< DataType > && std::is_trivial_v< DataType >, bool > = true
+		>
+		void set_data( const string_t& section, const string_t& name, const DataType& data )
+		{
+			set_binary( section, name, &data, sizeof( DataType ) );
+		}
+
+		void remove_key( const string_t& section, const string_t& name );
+
+		// Removes every [section] in the file with its keys. Keys set in the section afterwards are written to it anew.
+		void remove_section( const string_t& section );
+
+		// The number of keys and sections edited.
+		std::size_t size() const noexcept;
+		bool empty() const noexcept;
+
+		// Writes the edits and clears them. A file that does not exist is created.
+		// If it throws, the file is unchanged and the edits are kept. The one exception is ReplaceFile() failing
+		// after it has moved the original away: then the temporary file is kept, and the message names it.
+		void commit();
+
+		void rollback() noexcept;
+	private:
+		// The edits are kept in UTF-16 in both builds, as the file is edited.
+		struct key_edit
+		{
+			std::wstring name;
+			std::optional< std::wstring > value;		// nullopt removes the key
+		};
+
+		struct section_edit
+		{
+			std::wstring name;
+			bool removed = false;
+			std::vector< key_edit > keys;
+			std::unordered_map< std::wstring, std::size_t > keyIndex;		// folded name -> keys
+		};
+
+		section_edit& edit_section( const std::wstring& section );
+		void edit_key( const string_t& section, const string_t& name, std::optional< string_t > value );
+		std::wstring apply( std::wstring_view text ) const;
+
+		path_t m_file;
+		std::vector< section_edit > m_sections;
+		std::unordered_map< std::wstring, std::size_t > m_sectionIndex;		// folded name -> m_sections
+	};
 }
 
 #if defined( MYCPP_GLOBALTYPEDES )
@@ -438,7 +1556,23 @@ using MyCpp::module_handle_t;
 using MyCpp::mutex_t;
 using MyCpp::csptr_t;
 using MyCpp::cslock_t;
+using MyCpp::fast_mutex;
+using MyCpp::fmlock_t;
+using MyCpp::rw_mutex;
+using MyCpp::readlock_t;
+using MyCpp::writelock_t;
+using MyCpp::seqlock;
+using MyCpp::interprocess_mutex;
+using MyCpp::ipmutex_t;
 using MyCpp::processptr_t;
+using MyCpp::process_snapshot;
+using MyCpp::process_tree;
+using MyCpp::process_waiter;
+using MyCpp::output_reactor;
+using MyCpp::ini_document;
+using MyCpp::ini_transaction;
+using MyCpp::process_pool;
+using MyCpp::process_stats;
 using MyCpp::sidptr_t;
 using MyCpp::wndptr_t;
 #endif
@@ -0,0 +1,112 @@
+#include "MyCpp/Coroutine.hpp"
+#include "MyCpp/Error.hpp"
+#include "MyCpp/IntCast.hpp"
+
+#if MYCPP_STDCPP_VERSION >= 202002L
+
+namespace MyCpp
+{
+	// The callback and await_suspend() may finish in either order. Whichever comes second resumes the coroutine:
+	// await_suspend() by not suspending, the callback by posting the coroutine to the pool.
+
+	namespace
+	{
+		// A negative due time is relative, in 100 ns units.
+		FILETIME RelativeDueTime( qword milliseconds ) noexcept
+		{
+			qword due = static_cast< qword >( -static_cast< long long >( milliseconds * 10000 ) );
+
+			FILETIME time;
+			time.dwLowDateTime = static_cast< dword >( due );
+			time.dwHighDateTime = static_cast< dword >( due >> 32 );
+
+			return time;
+		}
+	}
+
+	handle_wait_awaiter::~handle_wait_awaiter()
+	{
+		if ( m_wait != null )
+		{
+			// The callback has normally finished by now; waiting for it costs nothing then.
+			::WaitForThreadpoolWaitCallbacks( m_wait, FALSE );
+			::CloseThreadpoolWait( m_wait );
+		}
+	}
+
+	bool handle_wait_awaiter::await_ready()
+	{
+		m_signaled = ( ::WaitForSingleObject( m_handle, 0 ) == WAIT_OBJECT_0 );
+		return m_signaled;
+	}
+
+	bool handle_wait_awaiter::await_suspend( std::coroutine_handle<> h )
+	{
+		m_continuation = h;
+		m_wait = ::CreateThreadpoolWait( &handle_wait_awaiter::Completed, this, null );
+
+		if ( m_wait == null )
+			exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateThreadpoolWait", "Failed. (0x%08x)", ::GetLastError() ) );
+
+		FILETIME timeout = RelativeDueTime( m_milliseconds );
+
+		::SetThreadpoolWait( m_wait, m_handle, ( m_milliseconds != INFINITE ) ? &timeout : null );
+
+		return !m_arrived.exchange( true, std::memory_order_acq_rel );
+	}
+
+	bool handle_wait_awaiter::await_resume() const noexcept
+	{
+		return m_signaled;
+	}
+
+	void CALLBACK handle_wait_awaiter::Completed( PTP_CALLBACK_INSTANCE, void* context, PTP_WAIT, TP_WAIT_RESULT result )
+	{
+		handle_wait_awaiter* self = static_cast< handle_wait_awaiter* >( context );
+
+		self->m_signaled = ( result != WAIT_TIMEOUT );
+
+		if ( self->m_arrived.exchange( true, std::memory_order_acq_rel ) )
+		{
+			std::coroutine_handle<> h = self->m_continuation;
+			self->m_pool.post( [h] { h.resume(); } );
+		}
+	}
+
+	sleep_awaiter::~sleep_awaiter()
+	{
+		if ( m_timer != null )
+		{
+			::WaitForThreadpoolTimerCallbacks( m_timer, FALSE );
+			::CloseThreadpoolTimer( m_timer );
+		}
+	}
+
+	bool sleep_awaiter::await_suspend( std::coroutine_handle<> h )
+	{
+		m_continuation = h;
+		m_timer = ::CreateThreadpoolTimer( &sleep_awaiter::Elapsed, this, null );
+
+		if ( m_timer == null )
+			exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateThreadpoolTimer", "Failed. (0x%08x)", ::GetLastError() ) );
+
+		FILETIME due = RelativeDueTime( numeric_cast< qword >( m_duration.count() ) );
+
+		::SetThreadpoolTimer( m_timer, &due, 0, 0 );
+
+		return !m_arrived.exchange( true, std::memory_order_acq_rel );
+	}
+
+	void CALLBACK sleep_awaiter::Elapsed( PTP_CALLBACK_INSTANCE, void* context, PTP_TIMER )
+	{
+		sleep_awaiter* self = static_cast< sleep_awaiter* >( context );
+
+		if ( self->m_arrived.exchange( true, std::memory_order_acq_rel ) )
+		{
+			std::coroutine_handle<> h = self->m_continuation;
+			self->m_pool.post( [h] { h.resume(); } );
+		}
+	}
+}
+
+#endif // MYCPP_STDCPP_VERSION >= 202002L
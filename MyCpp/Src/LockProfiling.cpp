@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include "MyCpp/LockProfiling.hpp"
+
+namespace MyCpp
+{
+#if defined( MYCPP_LOCK_PROFILING )
+	namespace details
+	{
+		struct lock_table;
+
+		struct lock_record
+		{
+			lock_table* table;
+			qword acquisitions;
+			qword contended;
+			std::chrono::nanoseconds waitTime;
+			std::chrono::nanoseconds maxHoldTime;
+		};
+	}
+
+	namespace
+	{
+		typedef std::tuple< const void*, string_t, const char*, int > lock_key;
+	}
+
+	namespace details
+	{
+		// The counters of one thread. Only the owning thread adds records, so the mutex is
+		// uncontended except while the counters are merged or reset.
+		// A table outlives its thread and is handed to the next new thread, so records
+		// referenced by locks that are still held stay valid.
+		struct lock_table
+		{
+			std::mutex mutex;
+			std::map< lock_key, lock_record > records;
+		};
+	}
+
+	namespace
+	{
+		struct LockRegistry
+		{
+			std::mutex mutex;
+			std::vector< details::lock_table* > tables;
+			std::vector< details::lock_table* > freeTables;
+		};
+
+		// Never destroyed, since locks may be released during static destruction.
+		LockRegistry& GetLockRegistry()
+		{
+			static LockRegistry* registry = new LockRegistry();
+			return *registry;
+		}
+
+		struct ThreadLockTable
+		{
+			~ThreadLockTable()
+			{
+				if ( table != null )
+				{
+					LockRegistry& registry = GetLockRegistry();
+					std::lock_guard< std::mutex > lock( registry.mutex );
+					registry.freeTables.push_back( table );
+				}
+			}
+
+			details::lock_table* get()
+			{
+				if ( table == null )
+				{
+					LockRegistry& registry = GetLockRegistry();
+					std::lock_guard< std::mutex > lock( registry.mutex );
+
+					if ( !registry.freeTables.empty() )
+					{
+						table = registry.freeTables.back();
+						registry.freeTables.pop_back();
+					}
+					else
+					{
+						std::unique_ptr< details::lock_table > newTable( new details::lock_table() );
+						registry.tables.push_back( newTable.get() );
+						table = newTable.release();
+					}
+				}
+
+				return table;
+			}
+
+			details::lock_table* table = null;
+		};
+
+		thread_local ThreadLockTable CurrentThreadTable;
+
+		void Merge( lock_stats& to, const details::lock_record& from )
+		{
+			to.acquisitions += from.acquisitions;
+			to.contended += from.contended;
+			to.wait_time += from.waitTime;
+			to.max_hold_time = ( std::max )( to.max_hold_time, from.maxHoldTime );
+		}
+	}
+
+	namespace details
+	{
+		lock_record* RecordLockAcquisition( const void* lock, const string_t* name, const lock_site& site, bool contended, std::chrono::nanoseconds waitTime ) noexcept
+		{
+			try
+			{
+				lock_table* table = CurrentThreadTable.get();
+				std::lock_guard< std::mutex > guard( table->mutex );
+
+				lock_key key( lock, ( name != null ) ? *name : string_t(), site.file, site.line );
+				auto it = table->records.find( key );
+
+				if ( it == table->records.end() )
+					it = table->records.emplace( std::move( key ), lock_record{ table, 0, 0, {}, {} } ).first;
+
+				lock_record& record = it->second;
+
+				++record.acquisitions;
+
+				if ( contended )
+				{
+					++record.contended;
+					record.waitTime += waitTime;
+				}
+
+				return &record;
+			}
+			catch ( ... )
+			{
+				return null;
+			}
+		}
+
+		// The table is locked through the record, since a lock may be released
+		// after the acquiring thread has exited.
+		void RecordLockRelease( lock_record* record, std::chrono::nanoseconds holdTime ) noexcept
+		{
+			std::lock_guard< std::mutex > guard( record->table->mutex );
+
+			if ( holdTime > record->maxHoldTime )
+				record->maxHoldTime = holdTime;
+		}
+	}
+
+	std::vector< lock_stats > GetLockProfile()
+	{
+		std::map< lock_key, lock_stats > merged;
+		LockRegistry& registry = GetLockRegistry();
+		std::lock_guard< std::mutex > registryLock( registry.mutex );
+
+		for ( details::lock_table* table : registry.tables )
+		{
+			std::lock_guard< std::mutex > tableLock( table->mutex );
+
+			for ( const auto& entry : table->records )
+			{
+				auto it = merged.find( entry.first );
+
+				if ( it == merged.end() )
+				{
+					const lock_key& key = entry.first;
+					lock_stats stats = { std::get< 0 >( key ), std::get< 1 >( key ), std::get< 2 >( key ), std::get< 3 >( key ), 0, 0, {}, {} };
+					it = merged.emplace( key, std::move( stats ) ).first;
+				}
+
+				Merge( it->second, entry.second );
+			}
+		}
+
+		std::vector< lock_stats > profile;
+		profile.reserve( merged.size() );
+
+		for ( auto& entry : merged )
+			profile.push_back( std::move( entry.second ) );
+
+		return profile;
+	}
+
+	void ResetLockProfile()
+	{
+		LockRegistry& registry = GetLockRegistry();
+		std::lock_guard< std::mutex > registryLock( registry.mutex );
+
+		// The records themselves are kept, because held locks still refer to them.
+		for ( details::lock_table* table : registry.tables )
+		{
+			std::lock_guard< std::mutex > tableLock( table->mutex );
+
+			for ( auto& entry : table->records )
+			{
+				details::lock_record& record = entry.second;
+				record.acquisitions = 0;
+				record.contended = 0;
+				record.waitTime = {};
+				record.maxHoldTime = {};
+			}
+		}
+	}
+#else
+	namespace details
+	{
+		lock_record* RecordLockAcquisition( const void* lock, const string_t* name, const lock_site& site, bool contended, std::chrono::nanoseconds waitTime ) noexcept
+		{
+			( void )lock;
+			( void )name;
+			( void )site;
+			( void )contended;
+			( void )waitTime;
+			return null;
+		}
+
+		void RecordLockRelease( lock_record* record, std::chrono::nanoseconds holdTime ) noexcept
+		{
+			( void )record;
+			( void )holdTime;
+		}
+	}
+
+	std::vector< lock_stats > GetLockProfile()
+	{
+		return {};
+	}
+
+	void ResetLockProfile()
+	{
+	}
+#endif
+
+	std::vector< lock_stats > GetHottestLocks( std::size_t n )
+	{
+		std::vector< lock_stats > profile = GetLockProfile();
+
+		auto hotter = []( const lock_stats& a, const lock_stats& b )
+		{
+			if ( a.wait_time != b.wait_time )
+				return ( a.wait_time > b.wait_time );
+
+			return ( a.contended > b.contended );
+		};
+
+		if ( n < profile.size() )
+		{
+			std::partial_sort( profile.begin(), profile.begin() + n, profile.end(), hotter );
+			profile.resize( n );
+		}
+		else
+		{
+			std::sort( profile.begin(), profile.end(), hotter );
+		}
+
+		return profile;
+	}
+}
@@ -0,0 +1,134 @@
+#include "MyCpp/MemoryTracking.hpp"
+
+namespace MyCpp
+{
+	namespace
+	{
+#if defined( MYCPP_ALLOCATION_TRACKING )
+		struct AllocationCounter
+		{
+			std::atomic< std::size_t > allocations;
+			std::atomic< std::size_t > deallocations;
+			std::atomic< std::size_t > allocatedBytes;
+			std::atomic< std::size_t > deallocatedBytes;
+			std::atomic< std::size_t > liveBytes;
+			std::atomic< std::size_t > peakBytes;
+		};
+
+		// Zero-initialized before any dynamic initialization takes place,
+		// so allocations made by other global constructors are counted too.
+		AllocationCounter Counters[ALLOC_TAG_COUNT];
+
+		inline AllocationCounter& GetCounter( alloc_tag tag ) noexcept
+		{
+			std::size_t index = static_cast< std::size_t >( tag );
+			return Counters[( index < ALLOC_TAG_COUNT ) ? index : 0];
+		}
+#endif
+
+		const char_t* const TagNames[ALLOC_TAG_COUNT] =
+		{
+			_T( "generic" ),
+			_T( "system_buffer" ),
+			_T( "text_buffer" ),
+			_T( "string_format" ),
+			_T( "local_memory" ),
+			_T( "global_memory" ),
+			_T( "heap_memory" ),
+			_T( "virtual_memory" ),
+			_T( "user" ),
+		};
+	}
+
+	namespace details
+	{
+		void RecordAllocation( alloc_tag tag, std::size_t bytes ) noexcept
+		{
+#if defined( MYCPP_ALLOCATION_TRACKING )
+			AllocationCounter& counter = GetCounter( tag );
+
+			counter.allocations.fetch_add( 1, std::memory_order_relaxed );
+			counter.allocatedBytes.fetch_add( bytes, std::memory_order_relaxed );
+
+			std::size_t live = counter.liveBytes.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+			std::size_t peak = counter.peakBytes.load( std::memory_order_relaxed );
+
+			while ( live > peak && !counter.peakBytes.compare_exchange_weak( peak, live, std::memory_order_relaxed ) )
+				;
+#else
+			( void )tag;
+			( void )bytes;
+#endif
+		}
+
+		void RecordDeallocation( alloc_tag tag, std::size_t bytes ) noexcept
+		{
+#if defined( MYCPP_ALLOCATION_TRACKING )
+			AllocationCounter& counter = GetCounter( tag );
+
+			counter.deallocations.fetch_add( 1, std::memory_order_relaxed );
+			counter.deallocatedBytes.fetch_add( bytes, std::memory_order_relaxed );
+			counter.liveBytes.fetch_sub( bytes, std::memory_order_relaxed );
+#else
+			( void )tag;
+			( void )bytes;
+#endif
+		}
+	}
+
+	allocation_stats GetAllocationStats( alloc_tag tag )
+	{
+#if defined( MYCPP_ALLOCATION_TRACKING )
+		const AllocationCounter& counter = GetCounter( tag );
+
+		return
+		{
+			counter.allocations.load( std::memory_order_relaxed ),
+			counter.deallocations.load( std::memory_order_relaxed ),
+			counter.allocatedBytes.load( std::memory_order_relaxed ),
+			counter.deallocatedBytes.load( std::memory_order_relaxed ),
+			counter.liveBytes.load( std::memory_order_relaxed ),
+			counter.peakBytes.load( std::memory_order_relaxed )
+		};
+#else
+		( void )tag;
+		return {};
+#endif
+	}
+
+	allocation_snapshot GetAllocationSnapshot()
+	{
+		allocation_snapshot snapshot = {};
+
+		for ( std::size_t i = 0; i < ALLOC_TAG_COUNT; ++i )
+			snapshot[i] = GetAllocationStats( static_cast< alloc_tag >( i ) );
+
+		return snapshot;
+	}
+
+	// Live bytes are kept, because the blocks they describe are still allocated.
+	// The high-water mark restarts from the current live bytes.
+	void ResetAllocationCounters()
+	{
+#if defined( MYCPP_ALLOCATION_TRACKING )
+		for ( auto& counter : Counters )
+		{
+			counter.allocations.store( 0, std::memory_order_relaxed );
+			counter.deallocations.store( 0, std::memory_order_relaxed );
+			counter.allocatedBytes.store( 0, std::memory_order_relaxed );
+			counter.deallocatedBytes.store( 0, std::memory_order_relaxed );
+			counter.peakBytes.store( counter.liveBytes.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+		}
+#endif
+	}
+
+	const char_t* GetAllocationTagName( alloc_tag tag )
+	{
+		std::size_t index = static_cast< std::size_t >( tag );
+
+		if ( index >= ALLOC_TAG_COUNT )
+			return _T( "unknown" );
+
+		return TagNames[index];
+	}
+}
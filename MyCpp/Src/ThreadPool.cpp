@@ -0,0 +1,325 @@
+#include <random>
+#include "MyCpp/Win32Base.hpp"
+#include "MyCpp/ThreadPool.hpp"
+
+namespace MyCpp
+{
+	// Chase-Lev deque, as given for weak memory models by Le, Pop, Cohen and Zappa Nardelli (PPoPP 2013).
+	// Only the owner calls push() and pop(), at the bottom. Any thread may call steal(), at the top.
+	// The slots are stored with release and loaded with acquire, which costs nothing on x86 and x64
+	// and publishes the task itself, not only its pointer. A full ring is replaced by one twice as large. Old rings are kept until the deque is destroyed,
+	// because a thief may still be reading one.
+	class thread_pool::work_deque
+	{
+	public:
+		explicit work_deque( std::size_t capacity = 256 )
+		{
+			m_rings.push_back( std::make_unique< ring >( capacity ) );
+			m_ring.store( m_rings.back().get(), std::memory_order_relaxed );
+		}
+
+		work_deque( const work_deque& ) = delete;
+		work_deque& operator = ( const work_deque& ) = delete;
+
+		void push( details::pool_task* task )
+		{
+			std::ptrdiff_t b = m_bottom.load( std::memory_order_relaxed );
+			std::ptrdiff_t t = m_top.load( std::memory_order_acquire );
+			ring* r = m_ring.load( std::memory_order_relaxed );
+
+			if ( b - t >= static_cast< std::ptrdiff_t >( r->capacity ) )
+				r = grow( r, t, b );
+
+			r->put( b, task );
+			std::atomic_thread_fence( std::memory_order_release );
+			m_bottom.store( b + 1, std::memory_order_relaxed );
+		}
+
+		details::pool_task* pop()
+		{
+			std::ptrdiff_t b = m_bottom.load( std::memory_order_relaxed ) - 1;
+			ring* r = m_ring.load( std::memory_order_relaxed );
+
+			m_bottom.store( b, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+
+			std::ptrdiff_t t = m_top.load( std::memory_order_relaxed );
+
+			if ( t > b )
+			{
+				m_bottom.store( b + 1, std::memory_order_relaxed );
+				return null;
+			}
+
+			details::pool_task* task = r->get( b );
+
+			// The last task; a thief may be taking it at the same time.
+			if ( t == b )
+			{
+				if ( !m_top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+					task = null;
+
+				m_bottom.store( b + 1, std::memory_order_relaxed );
+			}
+
+			return task;
+		}
+
+		details::pool_task* steal()
+		{
+			std::ptrdiff_t t = m_top.load( std::memory_order_acquire );
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+			std::ptrdiff_t b = m_bottom.load( std::memory_order_acquire );
+
+			if ( t >= b )
+				return null;
+
+			ring* r = m_ring.load( std::memory_order_acquire );
+			details::pool_task* task = r->get( t );
+
+			if ( !m_top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+				return null;
+
+			return task;
+		}
+	private:
+		struct ring
+		{
+			explicit ring( std::size_t n )
+				: capacity( n )
+				, mask( n - 1 )
+				, items( new std::atomic< details::pool_task* >[n] )
+			{}
+
+			details::pool_task* get( std::ptrdiff_t i ) const noexcept
+			{
+				return items[static_cast< std::size_t >( i ) & mask].load( std::memory_order_acquire );
+			}
+
+			void put( std::ptrdiff_t i, details::pool_task* task ) noexcept
+			{
+				items[static_cast< std::size_t >( i ) & mask].store( task, std::memory_order_release );
+			}
+
+			const std::size_t capacity;		// a power of 2
+			const std::size_t mask;
+			std::unique_ptr< std::atomic< details::pool_task* >[] > items;
+		};
+
+		ring* grow( ring* r, std::ptrdiff_t top, std::ptrdiff_t bottom )
+		{
+			auto larger = std::make_unique< ring >( r->capacity * 2 );
+
+			for ( std::ptrdiff_t i = top; i < bottom; ++i )
+				larger->put( i, r->get( i ) );
+
+			m_rings.push_back( std::move( larger ) );
+			m_ring.store( m_rings.back().get(), std::memory_order_release );
+
+			return m_rings.back().get();
+		}
+
+		alignas( 64 ) std::atomic< std::ptrdiff_t > m_top = 0;
+		alignas( 64 ) std::atomic< std::ptrdiff_t > m_bottom = 0;
+		std::atomic< ring* > m_ring;
+		std::vector< std::unique_ptr< ring > > m_rings;		// owner only
+	};
+
+	struct thread_pool::worker
+	{
+		work_deque deque;
+		std::thread thread;
+	};
+
+	namespace
+	{
+		struct CurrentWorker
+		{
+			const thread_pool* pool;
+			std::size_t index;
+		};
+
+		thread_local CurrentWorker CurrentThreadWorker = { null, 0 };
+
+		// Victims are visited from a random start, so thieves do not all hit the same worker.
+		inline std::size_t NextVictim( std::size_t count )
+		{
+			thread_local std::minstd_rand random( static_cast< std::minstd_rand::result_type >( std::hash< std::thread::id >()( std::this_thread::get_id() ) ) );
+			return random() % count;
+		}
+	}
+
+	thread_pool::thread_pool( std::size_t threads, bool pinThreads )
+		: m_injection( std::make_unique< work_deque >() )
+	{
+		if ( threads == 0 )
+			threads = std::max( std::thread::hardware_concurrency(), 1u );
+
+		m_workers.reserve( threads );
+
+		for ( std::size_t i = 0; i < threads; ++i )
+			m_workers.push_back( std::make_unique< worker >() );
+
+		// A worker may steal from any other as soon as it starts, so all are created first.
+		try
+		{
+			for ( std::size_t i = 0; i < threads; ++i )
+			{
+				m_workers[i]->thread = std::thread( &thread_pool::run, this, i );
+
+				// An affinity mask covers one processor group of up to 64 logical processors.
+				if ( pinThreads )
+				{
+					std::size_t processors = std::clamp< std::size_t >( std::thread::hardware_concurrency(), 1, sizeof( DWORD_PTR ) * 8 );
+					::SetThreadAffinityMask( m_workers[i]->thread.native_handle(), DWORD_PTR( 1 ) << ( i % processors ) );
+				}
+			}
+		}
+		catch ( ... )
+		{
+			{
+				std::lock_guard< std::mutex > lock( m_lock );
+				m_stop = true;
+			}
+
+			m_wake.notify_all();
+
+			for ( auto& w : m_workers )
+			{
+				if ( w->thread.joinable() )
+					w->thread.join();
+			}
+
+			throw;
+		}
+	}
+
+	thread_pool::~thread_pool()
+	{
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_stop = true;
+		}
+
+		m_wake.notify_all();
+
+		for ( auto& w : m_workers )
+			w->thread.join();
+	}
+
+	std::size_t thread_pool::size() const noexcept
+	{
+		return m_workers.size();
+	}
+
+	void thread_pool::enqueue( std::unique_ptr< details::pool_task > task )
+	{
+		// Counted before the push, so the count never drops below zero. It pairs with the sleeping
+		// count in run(): either the submitter sees a sleeper, or the sleeper sees the task.
+		m_queued.fetch_add( 1, std::memory_order_seq_cst );
+
+		try
+		{
+			if ( CurrentThreadWorker.pool == this )
+			{
+				m_workers[CurrentThreadWorker.index]->deque.push( task.get() );
+			}
+			else
+			{
+				std::lock_guard< std::mutex > lock( m_lock );
+				m_injection->push( task.get() );
+			}
+		}
+		catch ( ... )
+		{
+			m_queued.fetch_sub( 1, std::memory_order_relaxed );
+			throw;
+		}
+
+		task.release();
+
+		if ( m_sleeping.load( std::memory_order_seq_cst ) != 0 )
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_wake.notify_one();
+		}
+	}
+
+	// self is the index of the calling worker, or size() for other threads.
+	details::pool_task* thread_pool::find_task( std::size_t self )
+	{
+		details::pool_task* task = null;
+
+		if ( self < m_workers.size() )
+			task = m_workers[self]->deque.pop();
+
+		if ( task == null )
+			task = m_injection->steal();
+
+		if ( task == null )
+		{
+			std::size_t count = m_workers.size();
+			std::size_t start = NextVictim( count );
+
+			for ( std::size_t n = 0; n < count && task == null; ++n )
+			{
+				std::size_t victim = ( start + n ) % count;
+
+				if ( victim != self )
+					task = m_workers[victim]->deque.steal();
+			}
+		}
+
+		if ( task != null )
+			m_queued.fetch_sub( 1, std::memory_order_relaxed );
+
+		return task;
+	}
+
+	bool thread_pool::run_pending_task()
+	{
+		std::size_t self = ( CurrentThreadWorker.pool == this ) ? CurrentThreadWorker.index : m_workers.size();
+		std::unique_ptr< details::pool_task > task( find_task( self ) );
+
+		if ( !task )
+			return false;
+
+		task->run();
+		return true;
+	}
+
+	void thread_pool::run( std::size_t index )
+	{
+		CurrentThreadWorker = { this, index };
+
+		for ( ;; )
+		{
+			std::unique_ptr< details::pool_task > task( find_task( index ) );
+
+			if ( task )
+			{
+				task->run();
+				continue;
+			}
+
+			std::unique_lock< std::mutex > lock( m_lock );
+
+			m_sleeping.fetch_add( 1, std::memory_order_seq_cst );
+			m_wake.wait( lock, [this] { return ( m_stop || m_queued.load( std::memory_order_seq_cst ) != 0 ); } );
+			m_sleeping.fetch_sub( 1, std::memory_order_relaxed );
+
+			// Stops only when no task is left, so the destructor runs everything queued.
+			if ( m_stop && m_queued.load( std::memory_order_relaxed ) == 0 )
+				break;
+		}
+
+		CurrentThreadWorker = { null, 0 };
+	}
+
+	// Never destroyed, so that no worker is joined while the process exits.
+	thread_pool& thread_pool::shared()
+	{
+		static thread_pool* pool = new thread_pool();
+		return *pool;
+	}
+}
@@ -30,9 +30,10 @@ namespace MyCpp
 	string_t GetStringResource( handle_t instance_handle, uint id )
 	{
 		HINSTANCE hi = reinterpret_cast< HMODULE >( instance_handle );
-		vchar_t buffer( 1024 );
+		static adaptive_load_hint hint( _T( "GetStringResource" ) );
+		details::system_buffer< char_t, 1024 > buffer( 1024 );
 
-		adaptive_load( buffer, buffer.size(),
+		adaptive_load( buffer, buffer.size(), hint,
 			[&hi, &id] (char_t* ptr, std::size_t n)
 		{
 			return LoadString( hi, id, ptr, numeric_cast< int >( n ) ) + 1;
@@ -1,8 +1,17 @@
 #include "MyCpp/Win32System.hpp"
+#include "MyCpp/ThreadPool.hpp"
 #include "MyCpp/Error.hpp"
 #include "MyCpp/IntCast.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <system_error>
+#include <thread>
 
 #include <Objbase.h>
 #include <shellapi.h>
@@ -18,6 +27,7 @@
 #pragma comment( lib, "user32.lib" )
 #pragma comment( lib, "shell32.lib" )
 #pragma comment( lib, "ole32.lib" )
+#pragma comment( lib, "synchronization.lib" )
 
 #define REGVALUE_ERROR( calledFunction, key, value, errorCode ) \
 	_T( "[%s()] %s(\"%s\\%s\") Failed : 0x%08x" ), _T( __FUNCTION__ ), _T( calledFunction ), ( key ), ( value ), ( errorCode )
@@ -58,11 +68,43 @@ namespace MyCpp
 		}
 	}
 
+	namespace
+	{
+		// Zero-initialized, so hints may register themselves during dynamic initialization.
+		std::atomic< adaptive_load_hint* > AdaptiveLoadHints;
+	}
+
+	adaptive_load_hint::adaptive_load_hint( const char_t* name ) noexcept
+		: m_name( name )
+	{
+		if ( name != null )
+		{
+			adaptive_load_hint* head = AdaptiveLoadHints.load( std::memory_order_relaxed );
+
+			do
+			{
+				m_next = head;
+			}
+			while ( !AdaptiveLoadHints.compare_exchange_weak( head, this, std::memory_order_release, std::memory_order_relaxed ) );
+		}
+	}
+
+	std::vector< adaptive_load_stats > GetAdaptiveLoadStatistics()
+	{
+		std::vector< adaptive_load_stats > result;
+
+		for ( const adaptive_load_hint* hint = AdaptiveLoadHints.load( std::memory_order_acquire ); hint != null; hint = hint->next() )
+			result.push_back( hint->stats() );
+
+		return result;
+	}
+
 	path_t GetProgramModuleFileName( module_handle_t hmodule )
 	{
-		vchar_t buffer( MAX_PATH );
+		static adaptive_load_hint hint( _T( "GetProgramModuleFileName" ) );
+		details::system_buffer< char_t, MAX_PATH > buffer( MAX_PATH );
 
-		adaptive_load( buffer, buffer.size(),
+		adaptive_load( buffer, buffer.size(), hint,
 			[&hmodule] ( char_t* buffer, std::size_t n )
 		{
 			return ::GetModuleFileName( hmodule, buffer, numeric_cast< dword >( n ) );
@@ -78,9 +120,10 @@ namespace MyCpp
 
 	path_t GetTemporaryPath()
 	{
-		vchar_t buffer( MAX_PATH );
+		static adaptive_load_hint hint( _T( "GetTemporaryPath" ) );
+		details::system_buffer< char_t, MAX_PATH > buffer( MAX_PATH );
 
-		adaptive_load( buffer, buffer.size(),
+		adaptive_load( buffer, buffer.size(), hint,
 			[] ( char_t* buffer, std::size_t n )
 		{
 			return ::GetTempPath( numeric_cast< dword >( n ), buffer );
@@ -92,7 +135,7 @@ namespace MyCpp
 	path_t GetTemporaryFileName( const string_t& prefix )
 	{
 		string_t tempDir = to_string_t( GetTemporaryPath() );
-		vchar_t buffer( tempDir.length() + prefix.length() + 10 );
+		details::system_buffer< char_t, MAX_PATH > buffer( std::max< std::size_t >( MAX_PATH, tempDir.length() + prefix.length() + 10 ) );
 
 		::GetTempFileName( tempDir.c_str(), prefix.c_str(), 0, cstr_t( buffer ) );
 
@@ -101,7 +144,7 @@ namespace MyCpp
 
 	string_t ToGuidString( const guid_t& guid )
 	{
-		vwchar guidStr( 40 );
+		details::system_buffer< wchar_t, 40 > guidStr( 40 );
 
 		adaptive_load( guidStr, guidStr.size(),
 			[&guid] ( wchar_t* buffer, std::size_t n )
@@ -144,10 +187,11 @@ namespace MyCpp
 			if ( !filePath.has_extension() )
 				filePath.replace_extension( _T( ".exe" ) );
 
+			static adaptive_load_hint hint( _T( "ComplatePath" ) );
 			string_t pstr = to_string_t( p );
-			vchar_t szSearchPath( MAX_PATH );
+			details::system_buffer< char_t, MAX_PATH > szSearchPath( MAX_PATH );
 
-			adaptive_load( szSearchPath, szSearchPath.size(), 
+			adaptive_load( szSearchPath, szSearchPath.size(), hint,
 				[&pstr] ( char_t* s, std::size_t n )
 			{
 				return ::SearchPath( null, pstr.c_str(), null, numeric_cast< dword >( n ), s, null );
@@ -169,1029 +213,4026 @@ namespace MyCpp
 			return ph;
 		}
 
-		inline processptr_t FindProcessByFullPath( const path_t& fileName, bool inheritHandle, dword accessMode )
+		inline qword GetProcessCreationTime( handle_t process )
 		{
-			dword maxIndex = 0;
-			std::vector< dword > pids( 400 );
+			FILETIME creationTime, exitTime, kernelTime, userTime;
 
-			adaptive_load( pids, pids.size(),
-				[&maxIndex] ( dword* pn, std::size_t n )
-			{
-				dword size;
-				::EnumProcesses( pn, numeric_cast< dword >( n * sizeof( dword ) ), &size );
+			if ( ::GetProcessTimes( process, &creationTime, &exitTime, &kernelTime, &userTime ) == FALSE )
+				return 0;
+
+			return ( static_cast< qword >( creationTime.dwHighDateTime ) << 32 ) | creationTime.dwLowDateTime;
+		}
 
-				size /= sizeof( dword );
+		// Loads the ids of all processes. Returns the number of valid entries in pids.
+		template < std::size_t N >
+		inline std::size_t LoadProcessIds( details::system_buffer< dword, N >& pids, adaptive_load_hint& hint )
+		{
+			std::size_t count = adaptive_load( pids, pids.size(), hint,
+				[] ( dword* pn, std::size_t n )
+			{
+				dword size = 0;
 
-				if ( size < n )
-					maxIndex = size;
+				if ( ::EnumProcesses( pn, numeric_cast< dword >( n * sizeof( dword ) ), &size ) == FALSE )
+					return std::size_t( 0 );
 
-				return size;
+				return static_cast< std::size_t >( size / sizeof( dword ) );
 			} );
 
+			return std::min( count, pids.size() );
+		}
+
+		// Pids are handed out in chunks of this many.
+		constexpr std::size_t PROCESS_SCAN_CHUNK = 32;
+
+		// Opening a process and querying its image are separate kernel calls for every pid,
+		// so the chunks are scanned on the shared thread pool by at most threads threads ( 0 means the whole pool ).
+		inline std::vector< processptr_t > FindProcessesByFullPath( const path_t& fileName, bool inheritHandle, dword accessMode, bool findAll, std::size_t threads )
+		{
+			static adaptive_load_hint pidsHint( _T( "FindProcessByFullPath/EnumProcesses" ) );
+			static adaptive_load_hint pathHint( _T( "FindProcessByFullPath/QueryFullProcessImageName" ) );
+
+			details::system_buffer< dword, 400 > pids( 400 );
+			std::size_t count = LoadProcessIds( pids, pidsHint );
+
 			path_t searchPath = fileName;
-			vchar_t szProcessPath( MAX_PATH );
 
 			if ( !searchPath.is_absolute() )
 				searchPath = ComplatePath( searchPath );
 
-			string_t searchPathStr = to_string_t( searchPath );
+			const string_t searchPathStr = to_string_t( searchPath );
+			const std::size_t chunks = ( count + PROCESS_SCAN_CHUNK - 1 ) / PROCESS_SCAN_CHUNK;
+
+			std::vector< std::vector< processptr_t > > results( chunks );
+			std::atomic< bool > found = false;
 
-			for ( const auto& pid : pids )
+			auto scan =
+				[&] ( std::size_t chunk )
 			{
-				if ( auto ph = OpenProcessStandardRightsOrLimitedRights( accessMode, inheritHandle, pid ) )
+				details::system_buffer< char_t, MAX_PATH > szProcessPath( MAX_PATH );
+				std::size_t last = std::min( ( chunk + 1 ) * PROCESS_SCAN_CHUNK, count );
+
+				for ( std::size_t i = chunk * PROCESS_SCAN_CHUNK; i < last && ( findAll || !found.load( std::memory_order_relaxed ) ); ++i )
 				{
-					adaptive_load( szProcessPath, szProcessPath.size(),
-						[&ph] ( char_t* s, std::size_t n )
+					scoped_generic_handle process( OpenProcessStandardRightsOrLimitedRights( accessMode, inheritHandle, pids[i] ) );
+
+					if ( !process )
+						continue;
+
+					std::size_t length = adaptive_load( szProcessPath, szProcessPath.size(), pathHint,
+						[&process] ( char_t* s, std::size_t n )
 					{
 						DWORD size = numeric_cast< DWORD >( n );
-						if ( ::QueryFullProcessImageName( ph, 0, s, &size ) != FALSE )
-							return size + 1;
-						return 0UL;
+						if ( ::QueryFullProcessImageName( process.get(), 0, s, &size ) != FALSE )
+							return static_cast< std::size_t >( size + 1 );
+						if ( ::GetLastError() == ERROR_INSUFFICIENT_BUFFER )
+							return n;
+						return std::size_t( 0 );
 					} );
 
-					if ( ::_tcsicmp( cstr_t( szProcessPath ), to_string_t( searchPath ).c_str() ) == 0 )
-						return GetProcess( ph );
+					if ( length != 0 && ::_tcsicmp( cstr_t( szProcessPath ), searchPathStr.c_str() ) == 0 )
+					{
+						results[chunk].push_back( GetProcess( process.release() ) );
+
+						if ( !findAll )
+						{
+							found.store( true, std::memory_order_relaxed );
+							return;
+						}
+					}
 				}
+			};
+
+			if ( threads == 1 || chunks <= 1 )
+			{
+				for ( std::size_t chunk = 0; chunk < chunks; ++chunk )
+					scan( chunk );
+			}
+			else
+			{
+				thread_pool::shared().parallel_for( 0, chunks, scan, 1, threads );
 			}
 
-			return null;
-		}
+			std::vector< processptr_t > matches;
 
-		inline processptr_t FindProcessByFileName( const path_t& fileName, bool inheritHandle, dword accessMode )
-		{
-			PROCESSENTRY32 processEntry;
-			processEntry.dwSize = Fill0( processEntry );
+			for ( auto& r : results )
+				std::move( r.begin(), r.end(), std::back_inserter( matches ) );
 
-			string_t searchFileName = to_string_t( fileName );
+			if ( !findAll && matches.size() > 1 )
+				matches.resize( 1 );
 
-			scoped_generic_handle processSnapshot( ::CreateToolhelp32Snapshot( TH32CS_SNAPPROCESS, 0 ) );
+			return matches;
+		}
 
-			if ( processSnapshot.get() == INVALID_HANDLE_VALUE )
-				return null;
+		inline std::vector< processptr_t > FindProcessesByFileName( const path_t& fileName, bool inheritHandle, dword accessMode, bool findAll )
+		{
+			string_t searchFileName = to_string_t( fileName );
+			std::vector< processptr_t > matches;
 
-			if ( ::Process32First( processSnapshot.get(), &processEntry ) != FALSE )
+			ForEachProcessEntry(
+				[&] ( const process_entry& entry )
 			{
-				do
+				if ( ::_tcsicmp( entry.exeFile, searchFileName.c_str() ) != 0 )
+					return true;
+
+				if ( auto ph = OpenProcessStandardRightsOrLimitedRights( accessMode, inheritHandle, entry.pid ) )
 				{
-					if ( ::_tcsicmp( processEntry.szExeFile, searchFileName.c_str() ) == 0 )
-					{
-						if ( auto ph = OpenProcessStandardRightsOrLimitedRights( accessMode, inheritHandle, processEntry.th32ProcessID ) )
-							return GetProcess( ph );
-					}
+					matches.push_back( GetProcess( ph ) );
+					return findAll;
 				}
-				while ( ::Process32Next( processSnapshot.get(), &processEntry ) != FALSE );
-			}
 
-			return null;
+				return true;
+			} );
+
+			return matches;
 		}
-	}
 
-	processptr_t OpenProcessByFileName( const path_t& fileName, bool inheritHandle, dword accessMode )
-	{
-		if ( fileName.has_parent_path() )
-			return FindProcessByFullPath( fileName, inheritHandle, accessMode );
-		else
-			return FindProcessByFileName( fileName, inheritHandle, accessMode );
+		inline std::vector< processptr_t > FindProcesses( const path_t& fileName, bool inheritHandle, dword accessMode, bool findAll, std::size_t threads )
+		{
+			if ( fileName.has_parent_path() )
+				return FindProcessesByFullPath( fileName, inheritHandle, accessMode, findAll, threads );
+			else
+				return FindProcessesByFileName( fileName, inheritHandle, accessMode, findAll );
+		}
 	}
 
-	namespace
+	bool EnumProcessEntries( process_entry_callback callback, void* context )
 	{
-		void CoInitialize()
+		scoped_generic_handle snapshot( ::CreateToolhelp32Snapshot( TH32CS_SNAPPROCESS, 0 ) );
+
+		if ( snapshot.get() == INVALID_HANDLE_VALUE )
+			return false;
+
+		PROCESSENTRY32 processEntry;
+		processEntry.dwSize = Fill0( processEntry );
+
+		if ( ::Process32First( snapshot.get(), &processEntry ) != FALSE )
 		{
-			thread_local
-			struct CoInitializer
+			do
 			{
-				CoInitializer() 
-				{
-					m_result = ::CoInitialize( null );
-				}
-				~CoInitializer()
+				process_entry entry =
 				{
-					if ( SUCCEEDED( m_result ) )
-						::CoUninitialize();
-				}
-			private:
-				HRESULT m_result;
+					processEntry.th32ProcessID,
+					processEntry.th32ParentProcessID,
+					processEntry.cntThreads,
+					processEntry.szExeFile
+				};
+
+				if ( !callback( entry, context ) )
+					break;
 			}
-			CoThreadInitState;
+			while ( ::Process32Next( snapshot.get(), &processEntry ) != FALSE );
 		}
 
-		template < typename T >
-		struct CoMemoryDeleter
-		{
-			typedef T* pointer;
-			void operator () ( pointer p )
-			{
-				if ( p != null )
-					::CoTaskMemFree( p );
-			}
-		};
+		return true;
 	}
 
-	path_t GetSpecialFolderLocation( const guid_t& folderId )
+	processptr_t OpenProcessByFileName( const path_t& fileName, bool inheritHandle, dword accessMode )
 	{
-		CoInitialize();
-
-		LPWSTR psz;
-		HRESULT r = ::SHGetKnownFolderPath( folderId, 0, null, &psz );
+		auto matches = FindProcesses( fileName, inheritHandle, accessMode, false, 0 );
 
-		auto str = make_scoped_memory( psz, CoMemoryDeleter< wchar_t >() );
-
-		if ( FAILED( r ) )
-			exception< std::runtime_error >( FUNC_ERROR_ID( "SHGetKnownFolderPath", r ) );
+		return ( !matches.empty() ) ? matches.front() : null;
+	}
 
-		return str.get();
+	std::vector< processptr_t > OpenProcessesByFileName( const path_t& fileName, bool inheritHandle, dword accessMode, std::size_t threads )
+	{
+		return FindProcesses( fileName, inheritHandle, accessMode, true, threads );
 	}
 
-	path_t GetCurrentLocation()
+	namespace
 	{
-		vchar_t result( MAX_PATH );
+		struct ListedProcess
+		{
+			dword pid;
+			dword parentPid;
+			string_t name;
+		};
 
-		adaptive_load( result, result.size(),
-			[] ( char_t* buffer, std::size_t n )
+		inline path_t QueryProcessImagePath( handle_t process )
 		{
-			return ::GetCurrentDirectory( numeric_cast< dword >( n ), buffer );
-		} );
+			static adaptive_load_hint hint( _T( "process_snapshot/QueryFullProcessImageName" ) );
 
-		return cstr_t( result );
-	}
+			if ( process == null )
+				return path_t();
 
-	std::pair< dword, mutex_t > TryLockMutex( const string_t& name, bool waitForGetOwnership )
-	{
-		mutex_t mutex( ::CreateMutex( null, TRUE, name.c_str() ) );
-		dword lastError = ::GetLastError();
+			details::system_buffer< char_t, MAX_PATH > buffer( MAX_PATH );
 
-		if ( mutex && lastError == ERROR_ALREADY_EXISTS && waitForGetOwnership )
-		{
-			::WaitForSingleObject( mutex.get(), INFINITE );
-			lastError = ::GetLastError();
+			std::size_t length = adaptive_load( buffer, buffer.size(), hint,
+				[&process] ( char_t* s, std::size_t n )
+			{
+				DWORD size = numeric_cast< DWORD >( n );
+				if ( ::QueryFullProcessImageName( process, 0, s, &size ) != FALSE )
+					return static_cast< std::size_t >( size + 1 );
+				if ( ::GetLastError() == ERROR_INSUFFICIENT_BUFFER )
+					return n;
+				return std::size_t( 0 );
+			} );
+
+			if ( length == 0 )
+				return path_t();
+
+			return path_t( buffer.data() );
 		}
+	}
 
-		return std::make_pair( lastError, std::move( mutex ) );
+	process_snapshot::process_snapshot()
+	{
+		refresh();
 	}
 
-	namespace
+	void process_snapshot::refresh()
 	{
-		struct CriticalSectionDeleter
+		std::lock_guard< std::mutex > refreshLock( m_refreshLock );
+
+		std::vector< ListedProcess > listed;
+
+		ForEachProcessEntry(
+			[&listed] ( const process_entry& entry )
 		{
-			typedef LPCRITICAL_SECTION pointer;
+			listed.push_back( { entry.pid, entry.parentPid, entry.exeFile } );
+			return true;
+		} );
 
-			void operator () ( pointer p )
+		std::vector< dword > alive;
+		std::vector< const ListedProcess* > appeared;
+
+		alive.reserve( listed.size() );
+
+		{
+			std::shared_lock< std::shared_mutex > lock( m_lock );
+
+			for ( const auto& p : listed )
 			{
-				if ( p != null )
+				alive.push_back( p.pid );
+
+				auto it = m_byPid.find( p.pid );
+
+				// Only what the process list gives is compared, so a known process costs no kernel call.
+				// A reused pid with the same parent and image slips through; open() catches it by the creation time.
+				if ( it == m_byPid.end()
+					|| it->second->parentPid != p.parentPid
+					|| ::_tcsicmp( it->second->name.c_str(), p.name.c_str() ) != 0 )
 				{
-					::DeleteCriticalSection( p );
-					::LocalFree( reinterpret_cast< HLOCAL >( p ) );
+					appeared.push_back( &p );
 				}
 			}
-		};
-	}
-
-	cslock_t TryLockCriticalSection( CRITICAL_SECTION& csObj )
-	{
-		::EnterCriticalSection( &csObj );
+		}
 
-		cslock_t lock( &csObj );
+		std::sort( alive.begin(), alive.end() );
 
-		return lock;
-	}
+		// Opening the new processes is the expensive part, so it is done without the lock.
+		std::vector< entryptr_t > added;
 
-	csptr_t CreateCriticalSection( uint spinCount )
-	{
-		CRITICAL_SECTION* newCriticalSection = lcallocate< CRITICAL_SECTION >( LPTR, sizeof( CRITICAL_SECTION ) );
+		added.reserve( appeared.size() );
 
-#ifdef MYCPP_DEBUG
-		::InitializeCriticalSectionEx( newCriticalSection, spinCount, 0 );
-#else
-		::InitializeCriticalSectionEx( newCriticalSection, spinCount, CRITICAL_SECTION_NO_DEBUG_INFO );
-#endif
+		for ( const ListedProcess* p : appeared )
+		{
+			// The creation time and the image path are queried from the same handle, so they belong to one process.
+			scoped_generic_handle process( ::OpenProcess( PROCESS_QUERY_LIMITED_INFORMATION, FALSE, p->pid ) );
+			qword creationTime = ( process ) ? GetProcessCreationTime( process.get() ) : 0;
 
-		return { newCriticalSection, CriticalSectionDeleter() };
-	}
+			added.push_back( std::make_shared< entry >( entry { p->pid, p->parentPid, p->name, QueryProcessImagePath( process.get() ), creationTime } ) );
+		}
 
-	class Process::Data
-	{
-	public:
-		typedef PROCESS_INFORMATION ProcessInformation;
+		std::unique_lock< std::shared_mutex > lock( m_lock );
 
-		Data() = default;
-		Data( Data&& right ) noexcept = default;
-		Data( const ProcessInformation& info );
+		for ( auto it = m_byPid.begin(); it != m_byPid.end(); )
+		{
+			if ( std::binary_search( alive.begin(), alive.end(), it->first ) )
+			{
+				++it;
+				continue;
+			}
 
-		~Data();
+			erase( m_byName, key( it->second->name ), it->second );
+			erase( m_byPath, key( to_string_t( it->second->path ) ), it->second );
+			it = m_byPid.erase( it );
+		}
 
-		const ProcessInformation& GetProcessData() const;
-		const path_t& GetProcessFileName() const;
-		const string_t& GetProcessBaseName() const;
-	private:
-		mutable ProcessInformation m_process = {};
-		mutable csptr_t m_critical_section = CreateCriticalSection();
-		mutable path_t m_fileName;
-		mutable string_t m_baseName;
-	};
+		for ( const auto& e : added )
+		{
+			auto it = m_byPid.find( e->pid );
 
-	inline Process::Data::Data( const ProcessInformation& info )
-		: m_process( info )
-	{}
+			if ( it != m_byPid.end() )
+			{
+				erase( m_byName, key( it->second->name ), it->second );
+				erase( m_byPath, key( to_string_t( it->second->path ) ), it->second );
+				it->second = e;
+			}
+			else
+			{
+				m_byPid.emplace( e->pid, e );
+			}
 
-	inline Process::Data::~Data()
-	{
-		if ( m_process.hProcess != null	&& m_process.hProcess != ::GetCurrentProcess() )
-			::CloseHandle( m_process.hProcess );
+			m_byName.emplace( key( e->name ), e );
 
-		if ( m_process.hThread != null && m_process.hThread != ::GetCurrentThread() && m_process.hThread != PROCESS_PRIMARY_THREAD_HANDLE )
-			::CloseHandle( m_process.hThread );
+			if ( !e->path.empty() )
+				m_byPath.emplace( key( to_string_t( e->path ) ), e );
+		}
 	}
 
-	inline const Process::Data::ProcessInformation& Process::Data::GetProcessData() const
+	std::size_t process_snapshot::size() const
 	{
-		return m_process;
+		std::shared_lock< std::shared_mutex > lock( m_lock );
+		return m_byPid.size();
 	}
 
-	inline const path_t& Process::Data::GetProcessFileName() const
+	process_snapshot::entryptr_t process_snapshot::find( dword pid ) const
 	{
-		auto mutex = TryLockCriticalSection( m_critical_section );
+		std::shared_lock< std::shared_mutex > lock( m_lock );
 
-		if ( m_process.hProcess != null && m_fileName.empty() )
-		{
-			vchar_t buffer( MAX_PATH );
+		auto it = m_byPid.find( pid );
 
-			adaptive_load( buffer, buffer.size(),
-				[this] ( char_t* s, std::size_t n )
-			{
-				dword size = numeric_cast< dword >( n );
-				if ( ::QueryFullProcessImageName( m_process.hProcess, 0, s, &size ) != FALSE )
-					return size + 1;
-				return 0UL;
-			} );
+		return ( it != m_byPid.end() ) ? it->second : null;
+	}
 
-			m_fileName = cstr_t( buffer );
-		}
+	process_snapshot::entryptr_t process_snapshot::find_by_name( const string_t& fileName ) const
+	{
+		string_t k = key( fileName );
+		std::shared_lock< std::shared_mutex > lock( m_lock );
+
+		auto it = m_byName.find( k );
 
-		return m_fileName;
+		return ( it != m_byName.end() ) ? it->second : null;
 	}
 
-	inline const string_t& Process::Data::GetProcessBaseName() const
+	process_snapshot::entryptr_t process_snapshot::find_by_path( const path_t& fullPath ) const
 	{
-		auto mutex = TryLockCriticalSection( m_critical_section );
+		string_t k = key( to_string_t( fullPath ) );
+		std::shared_lock< std::shared_mutex > lock( m_lock );
 
-		if ( m_process.hProcess != null && m_baseName.empty() )
-			m_baseName = to_string_t( GetProcessFileName().filename() );
+		auto it = m_byPath.find( k );
 
-		return m_baseName;
+		return ( it != m_byPath.end() ) ? it->second : null;
 	}
 
+	std::vector< process_snapshot::entryptr_t > process_snapshot::find_all_by_name( const string_t& fileName ) const
+	{
+		string_t k = key( fileName );
+		std::shared_lock< std::shared_mutex > lock( m_lock );
 
-	Process::Process()
-		: m_data( std::make_shared< Data >() )
-	{}
+		return find_all( m_byName, k );
+	}
 
-	Process::Process( Data&& data )
-		: m_data( std::make_shared< Data >( std::move( data ) ) )
-	{}
+	std::vector< process_snapshot::entryptr_t > process_snapshot::find_all_by_path( const path_t& fullPath ) const
+	{
+		string_t k = key( to_string_t( fullPath ) );
+		std::shared_lock< std::shared_mutex > lock( m_lock );
 
-	Process::~Process()
-	{}
+		return find_all( m_byPath, k );
+	}
 
-	Process::PtrSID Process::GetSid() const
+	processptr_t process_snapshot::open( const path_t& fileName, bool inheritHandle, dword accessMode ) const
 	{
-		handle_t token = null;
+		std::vector< entryptr_t > candidates;
 
-		if ( ::OpenProcessToken( m_data->GetProcessData().hProcess, TOKEN_QUERY, &token) )
+		if ( fileName.has_parent_path() )
+			candidates = find_all_by_path( ComplatePath( fileName ) );
+		else
+			candidates = find_all_by_name( to_string_t( fileName ) );
+
+		// The pid may have been reused since the last refresh(), so the opened process must be the one indexed:
+		// created at the same time, or, if that was not known, running the same image.
+		for ( const auto& e : candidates )
 		{
-			dword bytes;
-			auto processToken = make_scoped_handle( token );
-			::GetTokenInformation( processToken.get(), TokenUser, null, 0, &bytes );
+			scoped_generic_handle process( OpenProcessStandardRightsOrLimitedRights( accessMode, inheritHandle, e->pid ) );
 
-			auto tokenUser = make_scoped_local_memory< TOKEN_USER >( LPTR, bytes );
-			if ( ::GetTokenInformation( processToken.get(), TokenUser, tokenUser.get(), bytes, &bytes ) != FALSE )
-			{
-				if ( ::IsValidSid( tokenUser->User.Sid ) != FALSE )
-				{
-					dword sidLength = ::GetLengthSid( tokenUser->User.Sid );
-					PtrSID psid( lcallocate< SID >( LPTR, sidLength ), local_memory_deleter< SID >() );
+			if ( !process )
+				continue;
 
-					::CopySid( sidLength, psid.get(), tokenUser->User.Sid);
+			bool same = ( e->creationTime != 0 )
+				? ( GetProcessCreationTime( process.get() ) == e->creationTime )
+				: ( ::_tcsicmp( to_string_t( QueryProcessImagePath( process.get() ).filename() ).c_str(), e->name.c_str() ) == 0 );
 
-					if ( ::IsValidSid( psid.get() ) != FALSE )
-						return psid;
-				}
-			}
+			if ( same )
+				return GetProcess( process.release() );
 		}
 
-		exception< std::runtime_error >( FUNC_ERROR_MSG( "Process::GetSid", "Failed: 0x%08x", ::GetLastError() ) );
-
 		return null;
 	}
 
-	Process::Ptr Process::GetParent() const
+	string_t process_snapshot::key( string_t s )
 	{
-		scoped_generic_handle snapshot( ::CreateToolhelp32Snapshot( TH32CS_SNAPPROCESS, 0 ) );
-
-		if ( snapshot.get() == INVALID_HANDLE_VALUE )
-			return null;
+		if ( !s.empty() )
+			::CharUpperBuff( &s[0], numeric_cast< dword >( s.size() ) );
 
-		dword processId = m_data->GetProcessData().dwProcessId;
+		return s;
+	}
 
-		PROCESSENTRY32 processEntry;
-		processEntry.dwSize = Fill0( processEntry );
+	void process_snapshot::erase( index_t& index, const string_t& k, const entryptr_t& e )
+	{
+		auto range = index.equal_range( k );
 
-		if ( ::Process32First( snapshot.get(), &processEntry ) != FALSE )
+		for ( auto it = range.first; it != range.second; ++it )
 		{
-			do
+			if ( it->second == e )
 			{
-				if ( processEntry.th32ProcessID == processId )
-				{
-					scoped_generic_handle process( OpenProcessStandardRightsOrLimitedRights( 0, false, processEntry.th32ParentProcessID ) );
-
-					if ( !process )
-						return null;
-
-					return std::make_shared< Process >( 
-						Process::Data( { process.release(), null, processEntry.th32ParentProcessID, 0 } ) );
-				}
+				index.erase( it );
+				return;
 			}
-			while ( ::Process32Next( snapshot.get(), &processEntry ) != FALSE );
 		}
-
-		return null;
 	}
 
-	Process* Process::GetCurrent()
+	std::vector< process_snapshot::entryptr_t > process_snapshot::find_all( const index_t& index, const string_t& k )
 	{
-		static Process currentProcess(
-			Process::Data( { ::GetCurrentProcess(), PROCESS_PRIMARY_THREAD_HANDLE, ::GetCurrentProcessId(), PROCESS_PRIMARY_THREAD_ID } ) );
+		std::vector< entryptr_t > result;
+		auto range = index.equal_range( k );
 
-		return &currentProcess;
+		for ( auto it = range.first; it != range.second; ++it )
+			result.push_back( it->second );
+
+		return result;
 	}
 
-	Process::Ptr Process::Create( const string_t& cmdline, const path_t& appCurrentDir, void* envVariables, int creationFlags, bool inheritHandle, int cmdShow )
+	process_tree::process_tree()
 	{
-		bool inQuote = false;
-		bool isQuotedName = false;
-
-		string_t appName;
+		std::vector< dword > parentPids;
 
-		auto i = cmdline.begin();
-
-		for ( ; i != cmdline.end(); ++i )
+		ForEachProcessEntry(
+			[this, &parentPids] ( const process_entry& entry )
 		{
-			if ( *i == _T( '"' ) )
-			{
-				inQuote = ( !inQuote );
-				if ( !isQuotedName )
-					isQuotedName = true;
-
-				continue;
-			}
-			else if ( !inQuote && _istspace( *i ) )
-			{
-				break;
-			}
+			m_pids.push_back( entry.pid );
+			m_names.push_back( entry.exeFile );
+			parentPids.push_back( entry.parentPid );
+			return true;
+		} );
 
-			appName += *i;
-		}
+		std::size_t count = m_pids.size();
 
-		path_t appCurrent = ( !appCurrentDir.empty() ) ?
-			std::filesystem::absolute( appCurrentDir ) : GetCurrentLocation();
+		m_slots.reserve( count );
+		for ( std::size_t i = 0; i < count; ++i )
+			m_slots.emplace( m_pids[i], i );
 
-		appName = to_string_t( ComplatePath( appName ) );
+		// A parent that has exited leaves its pid to be reused by an unrelated process.
+		// Such a process was created after the child, so, as Process Explorer does, the link is dropped.
+		std::vector< qword > creationTimes( count, 0 );
 
-		if ( !isQuotedName )
+		for ( std::size_t i = 0; i < count; ++i )
 		{
-			auto r = std::find_if( appName.begin(), appName.end(), &_istspace );
-			if ( r != appName.end() )
-				isQuotedName = true;
+			scoped_generic_handle process( ::OpenProcess( PROCESS_QUERY_LIMITED_INFORMATION, FALSE, m_pids[i] ) );
+
+			if ( process )
+				creationTimes[i] = GetProcessCreationTime( process.get() );
 		}
 
-		vchar_t cmdLineArgs;
+		m_parents.assign( count, npos );
+		for ( std::size_t i = 0; i < count; ++i )
+		{
+			if ( parentPids[i] == m_pids[i] )
+				continue;
 
-		if ( isQuotedName )
-			cmdLineArgs.push_back( _T( '"' ) );
+			std::size_t parent = slot_of( parentPids[i] );
 
-		std::copy( appName.begin(), appName.end(), std::back_inserter< vchar_t >( cmdLineArgs ) );
+			if ( parent != npos && creationTimes[parent] != 0 && creationTimes[i] != 0 && creationTimes[parent] > creationTimes[i] )
+				parent = npos;
 
-		if ( isQuotedName )
-			cmdLineArgs.push_back( _T( '"' ) );
+			m_parents[i] = parent;
+		}
 
-		std::copy( i, cmdline.end(), std::back_inserter< vchar_t >( cmdLineArgs ) );
+		// Processes that cannot be queried are linked by pid alone, and a reused pid among them can close a loop.
+		// Such links are cut, so every walk up the tree ends at a root.
+		enum : byte { unvisited, visiting, visited };
+		std::vector< byte > state( count, unvisited );
 
-		cmdLineArgs.push_back( char_t() );
+		for ( std::size_t i = 0; i < count; ++i )
+		{
+			std::size_t slot = i;
 
-		STARTUPINFO si;
+			while ( slot != npos && state[slot] == unvisited )
+			{
+				state[slot] = visiting;
 
-		si.cb = Fill0( si );
-		si.dwFlags = STARTF_USESHOWWINDOW;
-		si.wShowWindow = cmdShow;
+				std::size_t parent = m_parents[slot];
 
-		PROCESS_INFORMATION pi;
+				if ( parent != npos && state[parent] == visiting )
+				{
+					m_parents[slot] = npos;
+					parent = npos;
+				}
 
-		BOOL result = ::CreateProcess( appName.c_str()
-									   , cstr_t( cmdLineArgs )
-									   , null
-									   , null
-									   , ( inheritHandle ) ? TRUE : FALSE
-									   , creationFlags
-									   , envVariables
-									   , to_string_t( appCurrent ).c_str()
-									   , &si
-									   , &pi );
+				slot = parent;
+			}
 
-		if ( result == FALSE )
-			exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateProcess", "Failed. CommandLine = '%s', (0x%08x)", cmdLineArgs, ::GetLastError() ) );
+			for ( slot = i; slot != npos && state[slot] == visiting; slot = m_parents[slot] )
+				state[slot] = visited;
+		}
 
-		return std::make_shared< Process >( Data( pi ) );
-	}
+		m_childBegin.assign( count + 1, 0 );
+		for ( std::size_t i = 0; i < count; ++i )
+		{
+			if ( m_parents[i] != npos )
+				++m_childBegin[m_parents[i] + 1];
+		}
 
-	string_t Process::GetName() const
-	{
-		return m_data->GetProcessBaseName();
-	}
+		for ( std::size_t i = 0; i < count; ++i )
+			m_childBegin[i + 1] += m_childBegin[i];
 
-	path_t Process::GetFileName() const
-	{
-		return m_data->GetProcessFileName();
+		std::vector< std::size_t > next( m_childBegin.begin(), m_childBegin.end() - 1 );
+
+		m_children.resize( m_childBegin[count] );
+		for ( std::size_t i = 0; i < count; ++i )
+		{
+			if ( m_parents[i] != npos )
+				m_children[next[m_parents[i]]++] = i;
+		}
 	}
 
-	handle_t Process::GetHandle() const
+	const char_t* process_tree::name( dword pid ) const
 	{
-		return m_data->GetProcessData().hProcess;
-	};
+		std::size_t slot = slot_of( pid );
 
-	handle_t Process::GetPrimaryThreadHandle() const
-	{
-		return m_data->GetProcessData().hThread;
+		return ( slot != npos ) ? m_names[slot].c_str() : null;
 	}
 
-	dword Process::GetId() const
+	dword process_tree::parent( dword pid ) const
 	{
-		return m_data->GetProcessData().dwProcessId;
-	}
+		std::size_t slot = slot_of( pid );
 
-	dword Process::GetPrimaryThreadId() const
-	{
-		return m_data->GetProcessData().dwThreadId;
+		if ( slot == npos || m_parents[slot] == npos )
+			return invalid_pid;
+
+		return m_pids[m_parents[slot]];
 	}
 
-	dword Process::GetExitCode() const
+	std::vector< dword > process_tree::children( dword pid ) const
 	{
-		dword exitCode;
+		std::vector< dword > result;
+		std::size_t slot = slot_of( pid );
 
-		::GetExitCodeProcess( m_data->GetProcessData().hProcess, &exitCode );
+		if ( slot == npos )
+			return result;
 
-		return exitCode;
+		result.reserve( m_childBegin[slot + 1] - m_childBegin[slot] );
+		for ( std::size_t i = m_childBegin[slot]; i < m_childBegin[slot + 1]; ++i )
+			result.push_back( m_pids[m_children[i]] );
+
+		return result;
 	}
 
-	void Process::Terminate( int exitCode )
+	std::vector< dword > process_tree::ancestors( dword pid ) const
 	{
-		::TerminateProcess( m_data->GetProcessData().hProcess, exitCode );
+		std::vector< dword > result;
+		std::size_t slot = slot_of( pid );
+
+		if ( slot == npos )
+			return result;
+
+		for ( slot = m_parents[slot]; slot != npos; slot = m_parents[slot] )
+			result.push_back( m_pids[slot] );
+
+		return result;
 	}
 
-	namespace
+	std::vector< dword > process_tree::descendants( dword pid ) const
 	{
-		inline void SuspendProcess( dword processId, bool suspend )
+		std::vector< dword > result;
+
+		walk_subtree( pid,
+			[pid, &result] ( dword p, std::size_t )
 		{
-			scoped_generic_handle snapshot ( ::CreateToolhelp32Snapshot( TH32CS_SNAPTHREAD, processId ) );
-	
-			if ( snapshot.get() == INVALID_HANDLE_VALUE )
-				return ; // abort function.
-			
-			THREADENTRY32 thinfo;
-			thinfo.dwSize = Fill0( thinfo );
+			if ( p != pid )
+				result.push_back( p );
+			return true;
+		} );
 
-			if ( ::Thread32First( snapshot.get(), &thinfo ) != FALSE )
-			{
-				do
-				{
-					scoped_generic_handle thread( ::OpenThread( THREAD_SUSPEND_RESUME, FALSE, thinfo.th32ThreadID ) );
-					if ( thread )
-					{
-						if ( suspend )
-							::SuspendThread( thread.get() );
-						else
-							::ResumeThread( thread.get() );
-					}
-				}
-				while ( ::Thread32Next( snapshot.get(), &thinfo ) != FALSE );
-			}
-		}
+		return result;
 	}
 
-	void Process::Suspend()
+	std::size_t process_tree::slot_of( dword pid ) const
 	{
-		SuspendProcess( m_data->GetProcessData().dwProcessId, true );
+		auto it = m_slots.find( pid );
+
+		return ( it != m_slots.end() ) ? it->second : npos;
 	}
 
-	void Process::Resume()
+	struct process_waiter::registration
 	{
-		SuspendProcess( m_data->GetProcessData().dwProcessId, false );
+		process_waiter* owner;
+		processptr_t process;
+		handle_t wait;
+	};
+
+	process_waiter::~process_waiter()
+	{
+		std::unique_lock< std::mutex > lock( m_lock );
+
+		auto registrations = std::move( m_registrations );
+		m_registrations.clear();
+
+		lock.unlock();
+
+		// Blocks until a callback that has already started returns.
+		for ( auto& r : registrations )
+			::UnregisterWaitEx( r.second->wait, INVALID_HANDLE_VALUE );
+
+		lock.lock();
+		m_changed.wait( lock, [this] () { return ( m_running == 0 ); } );
 	}
 
-	dword Process::Wait( dword milliseconds, bool forInputIdle ) const
+	void process_waiter::add( const processptr_t& process )
 	{
-		if ( forInputIdle )
-			return ::WaitForInputIdle( m_data->GetProcessData().hProcess, milliseconds );
-		else
-			return ::WaitForSingleObject( m_data->GetProcessData().hProcess, milliseconds );
+		auto r = std::make_unique< registration >( registration { this, process, null } );
+
+		// The lock is held until the wait handle is stored,
+		// because the callback may run at once if the process has already exited.
+		std::lock_guard< std::mutex > lock( m_lock );
+
+		handle_t wait = null;
+
+		if ( ::RegisterWaitForSingleObject( &wait, process->GetHandle(), &process_waiter::OnExit, r.get(), INFINITE, WT_EXECUTEONLYONCE ) == FALSE )
+			exception< std::runtime_error >( FUNC_ERROR_MSG( "RegisterWaitForSingleObject", "Failed. pid = %u, (0x%08x)", process->GetId(), ::GetLastError() ) );
+
+		r->wait = wait;
+
+		registration* key = r.get();
+		m_registrations.emplace( key, std::move( r ) );
 	}
 
-	processptr_t GetProcess( dword pid )
+	bool process_waiter::remove( const processptr_t& process )
 	{
-		std::vector< dword > pids( 400 );
+		std::unique_ptr< registration > r;
 
-		adaptive_load( pids, pids.size(),
-			[] ( dword* pn, std::size_t n )
 		{
-			dword size;
-			::EnumProcesses( pn, numeric_cast< dword >( n * sizeof( dword ) ), &size );
+			std::lock_guard< std::mutex > lock( m_lock );
 
-			size /= sizeof( dword );
+			auto it = std::find_if( m_registrations.begin(), m_registrations.end(),
+				[&process] ( const auto& entry ) { return ( entry.second->process == process ); } );
 
-			return size;
-		} );
+			if ( it == m_registrations.end() )
+				return false;
 
-		if ( std::find( pids.begin(), pids.end(), pid) == pids.end() )
-			return null;
+			r = std::move( it->second );
+			m_registrations.erase( it );
+		}
 
-		handle_t process = OpenProcessStandardRightsOrLimitedRights( 0, false, pid );
-		if ( process == null )
-			return null;
+		// The callback finds no registration and returns. Wait for it, since it still uses r.
+		::UnregisterWaitEx( r->wait, INVALID_HANDLE_VALUE );
 
-		return std::make_shared< Process >( Process::Data( { process, null, pid, 0 } ) );
+		m_changed.notify_all();
+
+		return true;
 	}
 
-	processptr_t GetProcess( handle_t hProcess )
+	std::size_t process_waiter::pending() const
 	{
-		return std::make_shared< Process >( Process::Data( { hProcess, null, ::GetProcessId( hProcess ), 0 } ) );
+		std::lock_guard< std::mutex > lock( m_lock );
+		return m_registrations.size();
 	}
 
-	path_t FindFilePath( const string_t& filename, const string_t& ext )
+	template < typename Predicate >
+	bool process_waiter::wait_for( std::unique_lock< std::mutex >& lock, dword milliseconds, Predicate predicate )
 	{
-		vchar_t szSearchPath( MAX_PATH );
-
-		adaptive_load( szSearchPath, szSearchPath.size(), 
-			[&filename, &ext] ( char_t* s, std::size_t n )
+		if ( milliseconds == INFINITE )
 		{
-			return ::SearchPath( null, filename.c_str(), ( !ext.empty() ) ? ext.c_str() : null, numeric_cast< dword >( n ), s, null );
-		} );
+			m_changed.wait( lock, predicate );
+			return true;
+		}
 
-		return szSearchPath.data();
+		return m_changed.wait_for( lock, std::chrono::milliseconds( milliseconds ), predicate );
 	}
 
-	int RunElevated( const path_t& file, const string_t& parameters, bool waitForExit, int cmdShow )
+	processptr_t process_waiter::wait_any( dword milliseconds )
 	{
-		path_t filePath = ComplatePath( file );
-
-		string_t fileInfo = to_string_t( filePath.filename() );
-		string_t directoryInfo = to_string_t( filePath.parent_path() );
-
-		SHELLEXECUTEINFO shei;
-
-		shei.cbSize = Fill0( shei );
-		shei.lpVerb = _T( "runas" );
-		shei.lpFile = fileInfo.c_str();
-		shei.lpDirectory = directoryInfo.c_str();
-		shei.lpParameters = parameters.c_str();
-		shei.nShow = cmdShow;
+		std::unique_lock< std::mutex > lock( m_lock );
 
-		if ( waitForExit )
-			shei.fMask |= SEE_MASK_NOCLOSEPROCESS;
+		wait_for( lock, milliseconds,
+			[this] () { return ( !m_exited.empty() || ( m_registrations.empty() && m_running == 0 ) ); } );
 
-		::ShellExecuteEx( &shei );
+		if ( m_exited.empty() )
+			return null;
 
-		if ( shei.hProcess != null )
-		{
-			::WaitForSingleObject( shei.hProcess, INFINITE );
+		processptr_t process = std::move( m_exited.front() );
+		m_exited.pop_front();
 
-			dword dwExitCode;
-			::GetExitCodeProcess( shei.hProcess, &dwExitCode );
+		return process;
+	}
 
-			::CloseHandle( shei.hProcess );
+	bool process_waiter::wait_all( dword milliseconds )
+	{
+		std::unique_lock< std::mutex > lock( m_lock );
 
-			return static_cast< int >( dwExitCode );
-		}
+		return wait_for( lock, milliseconds,
+			[this] () { return ( m_registrations.empty() && m_running == 0 ); } );
+	}
 
-		int result = pointer_int_cast< int >( shei.hInstApp );
+	void process_waiter::set_callback( callback_t callback )
+	{
+		auto p = ( callback ) ? std::make_shared< callback_t >( std::move( callback ) ) : null;
 
-		return ( result <= 32 ) ? result : 0;
+		std::lock_guard< std::mutex > lock( m_lock );
+		m_callback = std::move( p );
 	}
 
-	namespace
+	void CALLBACK process_waiter::OnExit( void* context, BOOLEAN )
 	{
-		struct FINDWINDOWINFO
-		{
-			static constexpr std::size_t BUFFER_SIZE = 256;
-			HWND hwnd;
-			DWORD pid;
-			LPCTSTR className;
-			LPCTSTR windowName;
-			vchar_t buffer;
-			bool found;
-		};
+		registration* key = static_cast< registration* >( context );
+		process_waiter* owner = key->owner;
 
-		inline std::size_t GetWindowClassName( HWND hwnd, vchar_t& buffer )
-		{
-			return adaptive_load( buffer, buffer.size(),
-				[&hwnd] ( char_t* s, std::size_t n )
-			{
-				return ::GetClassName( hwnd, s, numeric_cast< int >( n ) );
-			} );
-		}
+		std::unique_ptr< registration > r;
+		std::shared_ptr< callback_t > callback;
 
-		inline std::size_t GetWindowName( HWND hwnd, vchar_t& buffer )
 		{
-			std::size_t size = ::GetWindowTextLength( hwnd ) + 1;
+			std::lock_guard< std::mutex > lock( owner->m_lock );
 
-			if ( buffer.size() < size )
-				buffer.resize( size );
+			auto it = owner->m_registrations.find( key );
 
-			return ::GetWindowText( hwnd, cstr_t( buffer ), numeric_cast< int >( buffer.size() ) );
+			// remove() or the destructor took it, and waits for this callback to return.
+			if ( it == owner->m_registrations.end() )
+				return;
+
+			r = std::move( it->second );
+			owner->m_registrations.erase( it );
+
+			callback = owner->m_callback;
+			++owner->m_running;
 		}
 
-		BOOL CALLBACK EnumChildWindowsProc(
-			HWND hwnd,      // qEBhẼnh
-			LPARAM lParam   // AvP[V`̒l
-		)
-		{
-			FINDWINDOWINFO* p = pointer_int_cast< FINDWINDOWINFO* >( lParam );
+		// Non-blocking, so it may be called from the callback itself.
+		::UnregisterWait( r->wait );
 
-			GetWindowClassName( hwnd, p->buffer );
-			if ( ::_tcsicmp( cstr_t( p->buffer ), p->className ) == 0 )
+		if ( callback )
+		{
+			try
 			{
-				GetWindowName( hwnd, p->buffer );
-				if ( p->windowName == null || ( p->windowName != null && ::_tcsicmp(cstr_t(p->buffer), p->windowName) == 0 ) )
-				{
-					p->hwnd = hwnd;
-					p->found = true;
-					return FALSE;
-				}
+				( *callback )( r->process );
+			}
+			catch ( ... )
+			{
+				// An exception must not escape into the thread pool.
 			}
-
-			// Search recursively until you finish finding or enumerating.
-			if ( !p->found )
-				::EnumChildWindows( hwnd, &EnumChildWindowsProc, lParam );
-
-			return ( p->found ) ? FALSE : TRUE;
 		}
-			
-		BOOL CALLBACK EnumChildWindowsProcEntry(
-			HWND hwnd,      // qEBhẼnh
-			LPARAM lParam   // AvP[V`̒l
-		)
+
 		{
-			FINDWINDOWINFO* p = pointer_int_cast< FINDWINDOWINFO* >( lParam );
+			std::lock_guard< std::mutex > lock( owner->m_lock );
 
-			// First check the first value.
-			if ( EnumChildWindowsProc( hwnd, lParam ) == FALSE )
-				return FALSE;
+			if ( !callback )
+				owner->m_exited.push_back( std::move( r->process ) );
 
-			// If not found, also look for child windows.
-			::EnumChildWindows( hwnd, &EnumChildWindowsProc, lParam );
+			--owner->m_running;
 
-			return ( p->found ) ? FALSE : TRUE;
+			// Notified under the lock, since the destructor may finish as soon as it is released.
+			owner->m_changed.notify_all();
 		}
+	}
 
-		BOOL CALLBACK EnumWindowsProc(
-			HWND hwnd,      // eEBhẼnh
-			LPARAM lParam   // AvP[V`̒l
-		)
+	struct output_reactor::stream
+	{
+		OVERLAPPED overlapped;
+		scoped_generic_handle pipe;
+		byte* buffer;
+		std::size_t size;
+		sink_t sink;
+	};
+
+	output_reactor::output_reactor( std::size_t threads )
+	{
+		if ( threads == 0 )
+			threads = std::max( std::thread::hardware_concurrency(), 1u );
+
+		m_port = ::CreateIoCompletionPort( INVALID_HANDLE_VALUE, null, 0, numeric_cast< dword >( threads ) );
+
+		if ( m_port == null )
+			exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateIoCompletionPort", "Failed. (0x%08x)", ::GetLastError() ) );
+
+		try
 		{
-			dword pid;
-			FINDWINDOWINFO* p = pointer_int_cast< FINDWINDOWINFO* >( lParam );
+			for ( std::size_t i = 0; i < threads; ++i )
+				m_workers.emplace_back( &output_reactor::run, this );
+		}
+		catch ( ... )
+		{
+			for ( std::size_t i = 0; i < m_workers.size(); ++i )
+				::PostQueuedCompletionStatus( m_port, 0, 0, null );
 
-			::GetWindowThreadProcessId( hwnd, &pid );
-			if ( pid == p->pid )
-			{
-				GetWindowClassName( hwnd, p->buffer );
-				if ( ::_tcsicmp( cstr_t( p->buffer ), p->className ) == 0 )
-				{
-					GetWindowName( hwnd, p->buffer );
-					if ( p->windowName == null || ( p->windowName != null && ::_tcsicmp( cstr_t( p->buffer ), p->windowName ) == 0 ) )
-					{
-						p->hwnd = hwnd;
-						p->found = true;
-						return FALSE;
-					}
-				}
-			}
+			for ( auto& t : m_workers )
+				t.join();
 
-			return TRUE;
+			::CloseHandle( m_port );
+			throw;
 		}
 	}
 
-	string_t Window::GetText() const
+	output_reactor::~output_reactor()
 	{
-		long_t nLength = ::SendMessage( m_hwnd, WM_GETTEXTLENGTH, 0, 0 );
-		vchar_t buffer( nLength + 1 );
+		m_stopping.store( true );
 
-		::SendMessage( m_hwnd, WM_GETTEXT, numeric_cast< WPARAM >( buffer.size() ), reinterpret_cast< LPARAM >( cstr_t( buffer ) ) );
+		// A read() that missed m_stopping finishes issuing its read before the reads are cancelled.
+		while ( m_issuing.load() != 0 )
+			std::this_thread::yield();
 
-		return cstr_t( buffer );
-	}
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
 
-	string_t Window::SetText( const string_t& text )
-	{
-		string_t old = this->GetText();
+			for ( auto& s : m_streams )
+				::CancelIoEx( s.second->pipe.get(), &s.second->overlapped );
+		}
 
-		this->Send( WM_SETTEXT, 0, reinterpret_cast< long_t >( text.c_str() ) );
+		wait( INFINITE );
 
-		return old;
+		// A null overlapped tells a worker to quit.
+		for ( std::size_t i = 0; i < m_workers.size(); ++i )
+			::PostQueuedCompletionStatus( m_port, 0, 0, null );
+
+		for ( auto& t : m_workers )
+			t.join();
+
+		::CloseHandle( m_port );
 	}
 
-	long_t Window::GetAttribute( int index ) const
+	void output_reactor::add( scoped_generic_handle pipe, byte* buffer, std::size_t size, sink_t sink )
 	{
-		return ::GetWindowLongPtr( m_hwnd, index );
+		auto s = std::make_unique< stream >();
+
+		Fill0( s->overlapped );
+		s->buffer = buffer;
+		s->size = std::min< std::size_t >( size, std::numeric_limits< dword >::max() );
+		s->sink = std::move( sink );
+
+		// The stream is the completion key of its pipe.
+		if ( ::CreateIoCompletionPort( pipe.get(), m_port, reinterpret_cast< ULONG_PTR >( s.get() ), 0 ) == null )
+			exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateIoCompletionPort", "Failed. (0x%08x)", ::GetLastError() ) );
+
+		s->pipe = std::move( pipe );
+
+		stream* key = s.get();
+
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_streams.emplace( key, std::move( s ) );
+		}
+
+		if ( !read( key ) )
+			finish( key );
 	}
 
-	long_t Window::SetAttribute( int index, long_t value )
+	std::size_t output_reactor::active() const
 	{
-		return ::SetWindowLongPtr( m_hwnd, index, value );
+		std::lock_guard< std::mutex > lock( m_lock );
+		return m_streams.size();
 	}
-	
-	string_t Window::GetClassNameText() const
+
+	bool output_reactor::wait( dword milliseconds )
 	{
-		vchar_t buffer;
+		std::unique_lock< std::mutex > lock( m_lock );
+		auto ended = [this] () { return m_streams.empty(); };
 
-		GetWindowClassName( m_hwnd, buffer );
+		if ( milliseconds == INFINITE )
+		{
+			m_changed.wait( lock, ended );
+			return true;
+		}
 
-		return cstr_t( buffer );
+		return m_changed.wait_for( lock, std::chrono::milliseconds( milliseconds ), ended );
+	}
+
+	// Returns false if no completion will come for the stream.
+	// No lock is taken, so the streams do not contend on each read. Instead, m_issuing is raised before
+	// m_stopping is checked, and the destructor sets m_stopping before it waits for m_issuing to drop to 0.
+	// So the destructor either cancels the read or stops it from being issued;
+	// a worker returning from a sink cannot start a read that nobody cancels.
+	bool output_reactor::read( stream* s )
+	{
+		m_issuing.fetch_add( 1 );
+
+		bool pending = false;
+
+		if ( !m_stopping.load() )
+		{
+			pending = ( ::ReadFile( s->pipe.get(), s->buffer, static_cast< dword >( s->size ), null, &s->overlapped ) != FALSE
+				|| ::GetLastError() == ERROR_IO_PENDING );
+		}
+
+		m_issuing.fetch_sub( 1 );
+
+		return pending;
+	}
+
+	void output_reactor::finish( stream* s )
+	{
+		try
+		{
+			s->sink( s->buffer, 0 );
+		}
+		catch ( ... )
+		{
+		}
+
+		std::unique_ptr< stream > owned;
+
+		std::lock_guard< std::mutex > lock( m_lock );
+
+		auto it = m_streams.find( s );
+		owned = std::move( it->second );
+		m_streams.erase( it );
+
+		m_changed.notify_all();
+	}
+
+	void output_reactor::run()
+	{
+		while ( true )
+		{
+			dword bytes = 0;
+			ULONG_PTR key = 0;
+			OVERLAPPED* overlapped = null;
+
+			BOOL result = ::GetQueuedCompletionStatus( m_port, &bytes, &key, &overlapped, INFINITE );
+
+			if ( overlapped == null )
+				return;
+
+			stream* s = reinterpret_cast< stream* >( key );
+
+			// A broken pipe, a cancelled read or a 0 byte read is the end of the stream.
+			if ( result == FALSE || bytes == 0 )
+			{
+				finish( s );
+				continue;
+			}
+
+			bool more = true;
+
+			try
+			{
+				s->sink( s->buffer, bytes );
+			}
+			catch ( ... )
+			{
+				// An exception must not end the worker. The stream is closed instead.
+				more = false;
+			}
+
+			if ( !more || !read( s ) )
+				finish( s );
+		}
+	}
+
+	namespace
+	{
+		void CoInitialize()
+		{
+			thread_local
+			struct CoInitializer
+			{
+				CoInitializer() 
+				{
+					m_result = ::CoInitialize( null );
+				}
+				~CoInitializer()
+				{
+					if ( SUCCEEDED( m_result ) )
+						::CoUninitialize();
+				}
+			private:
+				HRESULT m_result;
+			}
+			CoThreadInitState;
+		}
+
+		template < typename T >
+		struct CoMemoryDeleter
+		{
+			typedef T* pointer;
+			void operator () ( pointer p )
+			{
+				if ( p != null )
+					::CoTaskMemFree( p );
+			}
+		};
+	}
+
+	path_t GetSpecialFolderLocation( const guid_t& folderId )
+	{
+		CoInitialize();
+
+		LPWSTR psz;
+		HRESULT r = ::SHGetKnownFolderPath( folderId, 0, null, &psz );
+
+		auto str = make_scoped_memory( psz, CoMemoryDeleter< wchar_t >() );
+
+		if ( FAILED( r ) )
+			exception< std::runtime_error >( FUNC_ERROR_ID( "SHGetKnownFolderPath", r ) );
+
+		return str.get();
+	}
+
+	path_t GetCurrentLocation()
+	{
+		static adaptive_load_hint hint( _T( "GetCurrentLocation" ) );
+		details::system_buffer< char_t, MAX_PATH > result( MAX_PATH );
+
+		adaptive_load( result, result.size(), hint,
+			[] ( char_t* buffer, std::size_t n )
+		{
+			return ::GetCurrentDirectory( numeric_cast< dword >( n ), buffer );
+		} );
+
+		return cstr_t( result );
+	}
+
+	std::pair< dword, mutex_t > TryLockMutex( const string_t& name, bool waitForGetOwnership, const lock_site& site )
+	{
+		mutex_t mutex( ::CreateMutex( null, TRUE, name.c_str() ) );
+		dword lastError = ::GetLastError();
+		bool contended = false;		// the mutex was owned by someone else; an existing but free one is not contended
+		std::chrono::steady_clock::time_point start;
+
+		if ( mutex && lastError == ERROR_ALREADY_EXISTS && waitForGetOwnership )
+		{
+			// The mutex is owned even when abandoned, but what it protects may be inconsistent.
+			dword waitResult = ::WaitForSingleObject( mutex.get(), 0 );
+
+			if ( waitResult == WAIT_TIMEOUT )
+			{
+				contended = true;
+				start = std::chrono::steady_clock::now();
+				waitResult = ::WaitForSingleObject( mutex.get(), INFINITE );
+			}
+
+			lastError = ( waitResult == WAIT_ABANDONED ) ? ERROR_ABANDONED_WAIT_0 : ::GetLastError();
+		}
+
+#if defined( MYCPP_LOCK_PROFILING )
+		// An existing mutex is owned only after waiting for it. Only the blocking wait counts as wait time.
+		if ( mutex && ( lastError != ERROR_ALREADY_EXISTS || waitForGetOwnership ) )
+		{
+			auto acquired = std::chrono::steady_clock::now();
+			details::MutexDeleter& deleter = mutex.get_deleter();
+			deleter.record = details::RecordLockAcquisition( null, &name, site, contended, ( contended ) ? acquired - start : std::chrono::nanoseconds::zero() );
+			deleter.acquired = acquired;
+		}
+#else
+		( void )site;
+		( void )contended;
+		( void )start;
+#endif
+
+		return std::make_pair( lastError, std::move( mutex ) );
+	}
+
+	namespace
+	{
+		struct CriticalSectionDeleter
+		{
+			typedef LPCRITICAL_SECTION pointer;
+
+			void operator () ( pointer p )
+			{
+				if ( p != null )
+				{
+					::DeleteCriticalSection( p );
+					::LocalFree( reinterpret_cast< HLOCAL >( p ) );
+				}
+			}
+		};
+	}
+
+	cslock_t TryLockCriticalSection( CRITICAL_SECTION& csObj, const lock_site& site )
+	{
+#if defined( MYCPP_LOCK_PROFILING )
+		auto start = std::chrono::steady_clock::now();
+		bool contended = !::TryEnterCriticalSection( &csObj );
+
+		if ( contended )
+			::EnterCriticalSection( &csObj );
+
+		cslock_t lock( &csObj );
+
+		auto acquired = std::chrono::steady_clock::now();
+		details::CriticalSectionExit& exit = lock.get_deleter();
+		exit.record = details::RecordLockAcquisition( &csObj, null, site, contended, acquired - start );
+		exit.acquired = acquired;
+#else
+		( void )site;
+		::EnterCriticalSection( &csObj );
+
+		cslock_t lock( &csObj );
+#endif
+
+		return lock;
+	}
+
+	namespace
+	{
+		// Backoff rounds before parking. Round n pauses 2^n times, about 2000 pauses in total.
+		constexpr uint FAST_MUTEX_SPIN_ROUNDS = 10;
+	}
+
+	void fast_mutex::lock_contended() noexcept
+	{
+		static_assert( sizeof( m_state ) == sizeof( ulong ), "WaitOnAddress() needs a plain 4 byte value." );
+
+		for ( uint round = 0; round < FAST_MUTEX_SPIN_ROUNDS; ++round )
+		{
+			for ( uint i = 0; i < ( 1u << round ); ++i )
+				YieldProcessor();
+
+			// Parked threads are not bypassed for long; once one is parked, this thread parks too.
+			ulong state = m_state.load( std::memory_order_relaxed );
+
+			if ( state == CONTENDED )
+				break;
+
+			if ( state == UNLOCKED && try_lock() )
+				return;
+		}
+
+		// CONTENDED is stored even when the lock is taken here, since other threads may still be parked.
+		while ( m_state.exchange( CONTENDED, std::memory_order_acquire ) != UNLOCKED )
+		{
+			ulong contended = CONTENDED;
+			::WaitOnAddress( &m_state, &contended, sizeof( contended ), INFINITE );
+		}
+	}
+
+	void fast_mutex::wake_one() noexcept
+	{
+		::WakeByAddressSingle( &m_state );
+	}
+
+	void rw_mutex::lock() noexcept
+	{
+		m_state.fetch_add( WAITING_WRITER, std::memory_order_relaxed );
+
+		uint round = 0;
+		ulong state = m_state.load( std::memory_order_relaxed );
+
+		for ( ;; )
+		{
+			if ( ( state & ( WRITER | READERS ) ) == 0 )
+			{
+				if ( m_state.compare_exchange_weak( state, ( state - WAITING_WRITER ) | WRITER, std::memory_order_acquire, std::memory_order_relaxed ) )
+					return;
+
+				continue;
+			}
+
+			if ( round < FAST_MUTEX_SPIN_ROUNDS )
+			{
+				for ( uint i = 0; i < ( 1u << round ); ++i )
+					YieldProcessor();
+
+				++round;
+			}
+			else
+			{
+				::WaitOnAddress( &m_state, &state, sizeof( state ), INFINITE );
+			}
+
+			state = m_state.load( std::memory_order_relaxed );
+		}
+	}
+
+	void rw_mutex::unlock() noexcept
+	{
+		// Both readers and the other writers may be parked.
+		m_state.fetch_and( ~WRITER, std::memory_order_release );
+		::WakeByAddressAll( &m_state );
+	}
+
+	void rw_mutex::unlock_shared() noexcept
+	{
+		ulong state = m_state.fetch_sub( 1, std::memory_order_release );
+
+		// Writers wait for the last reader to leave. Readers wait here only if the reader count was full.
+		if ( ( ( state & READERS ) == 1 && ( state & WAITING_WRITERS ) != 0 ) || ( state & READERS ) == READERS )
+			::WakeByAddressAll( &m_state );
+	}
+
+	void rw_mutex::lock_shared_contended() noexcept
+	{
+		uint round = 0;
+		ulong state = m_state.load( std::memory_order_relaxed );
+
+		for ( ;; )
+		{
+			if ( ( state & ( WRITER | WAITING_WRITERS ) ) == 0 && ( state & READERS ) != READERS )
+			{
+				if ( m_state.compare_exchange_weak( state, state + 1, std::memory_order_acquire, std::memory_order_relaxed ) )
+					return;
+
+				continue;
+			}
+
+			if ( round < FAST_MUTEX_SPIN_ROUNDS )
+			{
+				for ( uint i = 0; i < ( 1u << round ); ++i )
+					YieldProcessor();
+
+				++round;
+			}
+			else
+			{
+				::WaitOnAddress( &m_state, &state, sizeof( state ), INFINITE );
+			}
+
+			state = m_state.load( std::memory_order_relaxed );
+		}
+	}
+
+	namespace
+	{
+		constexpr qword IPMUTEX_WAITERS = 1ull << 32;		// waiters may be parked on the wake event
+		constexpr dword IPMUTEX_POLL_INTERVAL = 100;		// ms, while the owner process cannot be watched
+	}
+
+	// state holds the owner's process id in the low 32 bits and IPMUTEX_WAITERS. It is 0 while unowned.
+	// ownerCreationTime tells the owner from a later process that reuses its id. It is 0 while the lock changes hands.
+	struct interprocess_mutex::shared_block
+	{
+		std::atomic< qword > state;
+		std::atomic< qword > ownerCreationTime;
+	};
+
+	interprocess_mutex::interprocess_mutex( const string_t& name )
+		: m_pid( ::GetCurrentProcessId() )
+		, m_creationTime( GetProcessCreationTime( ::GetCurrentProcess() ) )
+	{
+		static_assert( std::atomic< qword >::is_always_lock_free, "The lock word must be lock-free to be shared between processes." );
+
+		string_t mappingName = name + _T( ".lock" );
+		string_t wakeName = name + _T( ".wake" );
+
+		// A new mapping is zero filled, which is the unowned state.
+		m_mapping.reset( ::CreateFileMapping( INVALID_HANDLE_VALUE, null, PAGE_READWRITE, 0, sizeof( shared_block ), mappingName.c_str() ) );
+
+		if ( !m_mapping )
+			exception< std::runtime_error >( FUNC_ERROR_ID( "CreateFileMapping", ::GetLastError() ) );
+
+		m_view.reset( ::MapViewOfFile( m_mapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, sizeof( shared_block ) ) );
+
+		if ( !m_view )
+			exception< std::runtime_error >( FUNC_ERROR_ID( "MapViewOfFile", ::GetLastError() ) );
+
+		m_block = static_cast< shared_block* >( m_view.get() );
+
+		m_wake.reset( ::CreateEvent( null, FALSE, FALSE, wakeName.c_str() ) );
+
+		if ( !m_wake )
+			exception< std::runtime_error >( FUNC_ERROR_ID( "CreateEvent", ::GetLastError() ) );
+	}
+
+	bool interprocess_mutex::lock()
+	{
+		return ( acquire( true ) == ERROR_ABANDONED_WAIT_0 );
+	}
+
+	bool interprocess_mutex::try_lock()
+	{
+		return ( acquire( false ) != ERROR_ALREADY_EXISTS );
+	}
+
+	void interprocess_mutex::unlock() noexcept
+	{
+		m_block->ownerCreationTime.store( 0, std::memory_order_relaxed );
+
+		if ( ( m_block->state.exchange( 0, std::memory_order_release ) & IPMUTEX_WAITERS ) != 0 )
+			::SetEvent( m_wake.get() );
+	}
+
+	dword interprocess_mutex::acquire( bool wait )
+	{
+		const qword mine = m_pid;
+		qword expected = 0;
+
+		if ( m_block->state.compare_exchange_strong( expected, mine, std::memory_order_acq_rel, std::memory_order_relaxed ) )
+		{
+			publish_owner();
+			return ERROR_SUCCESS;
+		}
+
+		uint round = 0;
+		bool parked = false;
+
+		for ( ;; )
+		{
+			qword state = m_block->state.load( std::memory_order_acquire );
+
+			if ( state == 0 )
+			{
+				// Once this process has parked, others may be parked too, so the waiter flag is kept.
+				if ( m_block->state.compare_exchange_weak( state, ( parked ) ? ( mine | IPMUTEX_WAITERS ) : mine, std::memory_order_acq_rel, std::memory_order_relaxed ) )
+				{
+					publish_owner();
+					return ERROR_SUCCESS;
+				}
+
+				continue;
+			}
+
+			if ( wait && round < FAST_MUTEX_SPIN_ROUNDS )
+			{
+				for ( uint i = 0; i < ( 1u << round ); ++i )
+					YieldProcessor();
+
+				++round;
+				continue;
+			}
+
+			qword creationTime = m_block->ownerCreationTime.load( std::memory_order_acquire );
+
+			if ( m_block->state.load( std::memory_order_relaxed ) != state )
+				continue;
+
+			scoped_generic_handle ownerProcess;
+
+			if ( is_owner_dead( state, creationTime, ownerProcess ) )
+			{
+				// The creation time is cleared first, so that nobody judges the new owner by the dead owner's time.
+				if ( creationTime != 0 && !m_block->ownerCreationTime.compare_exchange_strong( creationTime, 0, std::memory_order_acq_rel ) )
+					continue;
+
+				if ( m_block->state.compare_exchange_strong( state, mine | IPMUTEX_WAITERS, std::memory_order_acq_rel, std::memory_order_relaxed ) )
+				{
+					publish_owner();
+					return ERROR_ABANDONED_WAIT_0;
+				}
+
+				continue;
+			}
+
+			if ( !wait )
+				return ERROR_ALREADY_EXISTS;
+
+			if ( ( state & IPMUTEX_WAITERS ) == 0 &&
+				!m_block->state.compare_exchange_weak( state, state | IPMUTEX_WAITERS, std::memory_order_relaxed ) )
+				continue;
+
+			parked = true;
+
+			// The auto-reset event keeps a wake that arrives before the wait.
+			if ( ownerProcess )
+			{
+				handle_t handles[] = { m_wake.get(), ownerProcess.get() };
+				::WaitForMultipleObjects( 2, handles, FALSE, INFINITE );
+			}
+			else
+			{
+				::WaitForSingleObject( m_wake.get(), IPMUTEX_POLL_INTERVAL );
+			}
+		}
+	}
+
+	// ownerProcess receives a handle to wait on while the owner is alive, if it can be opened.
+	bool interprocess_mutex::is_owner_dead( qword state, qword ownerCreationTime, scoped_generic_handle& ownerProcess ) const
+	{
+		dword owner = static_cast< dword >( state );
+
+		if ( owner == m_pid )
+			return false;
+
+		ownerProcess.reset( ::OpenProcess( SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, owner ) );
+
+		// ERROR_ACCESS_DENIED means the owner is alive but out of reach; it is polled.
+		if ( !ownerProcess )
+			return ( ::GetLastError() == ERROR_INVALID_PARAMETER );
+
+		if ( ::WaitForSingleObject( ownerProcess.get(), 0 ) == WAIT_OBJECT_0 )
+			return true;
+
+		qword creationTime = GetProcessCreationTime( ownerProcess.get() );
+
+		return ( ownerCreationTime != 0 && creationTime != 0 && creationTime != ownerCreationTime );
+	}
+
+	void interprocess_mutex::publish_owner() noexcept
+	{
+		m_block->ownerCreationTime.store( m_creationTime, std::memory_order_release );
+	}
+
+	std::pair< dword, ipmutex_t > TryLockInterprocessMutex( const string_t& name, bool waitForGetOwnership )
+	{
+		std::unique_ptr< interprocess_mutex > mutex( new interprocess_mutex( name ) );
+		dword result = mutex->acquire( waitForGetOwnership );
+
+		if ( result == ERROR_ALREADY_EXISTS )
+			return std::make_pair( result, ipmutex_t() );
+
+		return std::make_pair( result, ipmutex_t( mutex.release() ) );
+	}
+
+	csptr_t CreateCriticalSection( uint spinCount )
+	{
+		CRITICAL_SECTION* newCriticalSection = lcallocate< CRITICAL_SECTION >( LPTR, sizeof( CRITICAL_SECTION ) );
+
+#ifdef MYCPP_DEBUG
+		::InitializeCriticalSectionEx( newCriticalSection, spinCount, 0 );
+#else
+		::InitializeCriticalSectionEx( newCriticalSection, spinCount, CRITICAL_SECTION_NO_DEBUG_INFO );
+#endif
+
+		return { newCriticalSection, CriticalSectionDeleter() };
+	}
+
+	namespace
+	{
+		// Pseudo handles are not owned, so they are copied as they are.
+		inline bool IsOwnedProcessDataHandle( handle_t h )
+		{
+			return ( h != null && h != ::GetCurrentProcess() && h != ::GetCurrentThread() && h != PROCESS_PRIMARY_THREAD_HANDLE );
+		}
+
+		handle_t DuplicateProcessDataHandle( handle_t h )
+		{
+			if ( !IsOwnedProcessDataHandle( h ) )
+				return h;
+
+			dword flags = 0;
+			BOOL inherit = ( ::GetHandleInformation( h, &flags ) != FALSE && ( flags & HANDLE_FLAG_INHERIT ) != 0 ) ? TRUE : FALSE;
+			handle_t copy = null;
+
+			if ( ::DuplicateHandle( ::GetCurrentProcess(), h, ::GetCurrentProcess(), &copy, 0, inherit, DUPLICATE_SAME_ACCESS ) == FALSE )
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "DuplicateHandle", "Failed. (0x%08x)", ::GetLastError() ) );
+
+			return copy;
+		}
+	}
+
+	Process::Data::Data( Data&& right ) noexcept
+		: m_process( right.m_process )
+	{
+		// The handles move to this object. The names are queried again if needed.
+		right.m_process = {};
+	}
+
+	Process::Data::Data( const Data& right )
+		: m_process( right.m_process )
+	{
+		m_process.hProcess = null;
+		m_process.hThread = null;
+
+		scoped_generic_handle process( DuplicateProcessDataHandle( right.m_process.hProcess ) );
+		m_process.hThread = DuplicateProcessDataHandle( right.m_process.hThread );
+		m_process.hProcess = process.release();
+
+		if ( right.m_namesReady.load( std::memory_order_acquire ) )
+		{
+			m_fileName = right.m_fileName;
+			m_baseName = right.m_baseName;
+			m_namesReady.store( true, std::memory_order_relaxed );
+		}
+	}
+
+	Process::Data::Data( const ProcessInformation& info )
+		: m_process( info )
+	{}
+
+	Process::Data& Process::Data::operator = ( Data right ) noexcept
+	{
+		Close();
+
+		m_process = right.m_process;
+		right.m_process = {};
+
+		bool ready = right.m_namesReady.load( std::memory_order_relaxed );
+
+		m_fileName = std::move( right.m_fileName );
+		m_baseName = std::move( right.m_baseName );
+		m_namesReady.store( ready, std::memory_order_release );
+
+		return *this;
+	}
+
+	Process::Data::~Data()
+	{
+		Close();
+	}
+
+	void Process::Data::Close() noexcept
+	{
+		if ( IsOwnedProcessDataHandle( m_process.hProcess ) )
+			::CloseHandle( m_process.hProcess );
+
+		if ( IsOwnedProcessDataHandle( m_process.hThread ) )
+			::CloseHandle( m_process.hThread );
+
+		m_process = {};
+	}
+
+	const Process::Data::ProcessInformation& Process::Data::GetProcessData() const
+	{
+		return m_process;
+	}
+
+	bool Process::Data::QueryNames() const
+	{
+		if ( m_process.hProcess == null )
+			return false;
+
+		static adaptive_load_hint hint( _T( "Process::GetFileName" ) );
+		details::system_buffer< char_t, MAX_PATH > buffer( MAX_PATH );
+
+		std::size_t length = adaptive_load( buffer, buffer.size(), hint,
+			[this] ( char_t* s, std::size_t n )
+		{
+			dword size = numeric_cast< dword >( n );
+			if ( ::QueryFullProcessImageName( m_process.hProcess, 0, s, &size ) != FALSE )
+				return static_cast< std::size_t >( size + 1 );
+			if ( ::GetLastError() == ERROR_INSUFFICIENT_BUFFER )
+				return n;
+			return std::size_t( 0 );
+		} );
+
+		if ( length == 0 )
+			return false;
+
+		m_fileName = cstr_t( buffer );
+		m_baseName = to_string_t( m_fileName.filename() );
+
+		return true;
+	}
+
+	// After the names are loaded, this is one acquire load. Until then every call queries again,
+	// so a transient failure such as a denied access is not kept.
+	// The fast path holds because m_namesReady goes back to false only in operator =, which is not
+	// allowed to run concurrently with this const call.
+	bool Process::Data::LoadNames() const
+	{
+		if ( m_namesReady.load( std::memory_order_acquire ) )
+			return true;
+
+		auto lock = LockFastMutex( m_namesLock );
+
+		if ( m_namesReady.load( std::memory_order_relaxed ) )
+			return true;
+
+		if ( !QueryNames() )
+			return false;
+
+		m_namesReady.store( true, std::memory_order_release );
+		return true;
+	}
+
+	// The names are read only once published, as they are never written after that.
+	const path_t& Process::Data::GetProcessFileName() const
+	{
+		static const path_t none;
+		return ( LoadNames() ) ? m_fileName : none;
+	}
+
+	const string_t& Process::Data::GetProcessBaseName() const
+	{
+		static const string_t none;
+		return ( LoadNames() ) ? m_baseName : none;
+	}
+
+	Process::Process()
+	{}
+
+	Process::Process( Data&& data )
+		: m_data( std::move( data ) )
+	{}
+
+	Process::~Process()
+	{}
+
+	Process::PtrSID Process::GetSid() const
+	{
+		handle_t token = null;
+
+		if ( ::OpenProcessToken( m_data.GetProcessData().hProcess, TOKEN_QUERY, &token) )
+		{
+			dword bytes;
+			auto processToken = make_scoped_handle( token );
+			::GetTokenInformation( processToken.get(), TokenUser, null, 0, &bytes );
+
+			auto tokenUser = make_scoped_local_memory< TOKEN_USER >( LPTR, bytes );
+			if ( ::GetTokenInformation( processToken.get(), TokenUser, tokenUser.get(), bytes, &bytes ) != FALSE )
+			{
+				if ( ::IsValidSid( tokenUser->User.Sid ) != FALSE )
+				{
+					dword sidLength = ::GetLengthSid( tokenUser->User.Sid );
+					PtrSID psid( lcallocate< SID >( LPTR, sidLength ), local_memory_deleter< SID >() );
+
+					::CopySid( sidLength, psid.get(), tokenUser->User.Sid);
+
+					if ( ::IsValidSid( psid.get() ) != FALSE )
+						return psid;
+				}
+			}
+		}
+
+		exception< std::runtime_error >( FUNC_ERROR_MSG( "Process::GetSid", "Failed: 0x%08x", ::GetLastError() ) );
+
+		return null;
+	}
+
+	Process::Ptr Process::GetParent() const
+	{
+		dword processId = m_data.GetProcessData().dwProcessId;
+		dword parentId = 0;
+		bool found = false;
+
+		ForEachProcessEntry(
+			[&] ( const process_entry& entry )
+		{
+			if ( entry.pid != processId )
+				return true;
+
+			parentId = entry.parentPid;
+			found = true;
+			return false;
+		} );
+
+		if ( !found )
+			return null;
+
+		scoped_generic_handle process( OpenProcessStandardRightsOrLimitedRights( 0, false, parentId ) );
+
+		if ( !process )
+			return null;
+
+		return std::make_shared< Process >( 
+			Process::Data( { process.release(), null, parentId, 0 } ) );
+	}
+
+	void Process::PrefetchNames( const Ptr* processes, std::size_t count )
+	{
+		for ( std::size_t i = 0; i < count; ++i )
+		{
+			if ( processes[i] )
+				processes[i]->m_data.LoadNames();
+		}
+	}
+
+	Process* Process::GetCurrent()
+	{
+		static Process currentProcess(
+			Process::Data( { ::GetCurrentProcess(), PROCESS_PRIMARY_THREAD_HANDLE, ::GetCurrentProcessId(), PROCESS_PRIMARY_THREAD_ID } ) );
+
+		return &currentProcess;
+	}
+
+	namespace
+	{
+		PROCESS_INFORMATION LaunchProcess( const string_t& cmdline, const path_t& appCurrentDir, void* envVariables, dword creationFlags, bool inheritHandle, STARTUPINFO* si )
+		{
+			bool inQuote = false;
+			bool isQuotedName = false;
+
+			string_t appName;
+
+			auto i = cmdline.begin();
+
+			for ( ; i != cmdline.end(); ++i )
+			{
+				if ( *i == _T( '"' ) )
+				{
+					inQuote = ( !inQuote );
+					if ( !isQuotedName )
+						isQuotedName = true;
+
+					continue;
+				}
+				else if ( !inQuote && _istspace( *i ) )
+				{
+					break;
+				}
+
+				appName += *i;
+			}
+
+			path_t appCurrent = ( !appCurrentDir.empty() ) ?
+				std::filesystem::absolute( appCurrentDir ) : GetCurrentLocation();
+
+			appName = to_string_t( ComplatePath( appName ) );
+
+			if ( !isQuotedName )
+			{
+				auto r = std::find_if( appName.begin(), appName.end(), &_istspace );
+				if ( r != appName.end() )
+					isQuotedName = true;
+			}
+
+			details::system_buffer< char_t, MAX_PATH > cmdLineArgs;
+
+			if ( isQuotedName )
+				cmdLineArgs.push_back( _T( '"' ) );
+
+			std::copy( appName.begin(), appName.end(), std::back_inserter( cmdLineArgs ) );
+
+			if ( isQuotedName )
+				cmdLineArgs.push_back( _T( '"' ) );
+
+			std::copy( i, cmdline.end(), std::back_inserter( cmdLineArgs ) );
+
+			cmdLineArgs.push_back( char_t() );
+
+			PROCESS_INFORMATION pi;
+
+			BOOL result = ::CreateProcess( appName.c_str()
+										   , cstr_t( cmdLineArgs )
+										   , null
+										   , null
+										   , ( inheritHandle ) ? TRUE : FALSE
+										   , creationFlags
+										   , envVariables
+										   , to_string_t( appCurrent ).c_str()
+										   , si
+										   , &pi );
+
+			if ( result == FALSE )
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateProcess", "Failed. CommandLine = '%s', (0x%08x)", cmdLineArgs, ::GetLastError() ) );
+
+			return pi;
+		}
+
+		constexpr dword OUTPUT_PIPE_SIZE = 64 * 1024;
+
+		// Anonymous pipes cannot be read with overlapped I/O, so a uniquely named pipe is used.
+		// The read end is overlapped and not inheritable, the write end is inheritable.
+		void CreateOutputPipe( scoped_generic_handle& readEnd, scoped_generic_handle& writeEnd )
+		{
+			static std::atomic< ulong > serial = 0;
+
+			string_t name = strprintf( _T( "\\\\.\\pipe\\MyCpp.Output.%u.%u" ), ::GetCurrentProcessId(), serial.fetch_add( 1, std::memory_order_relaxed ) );
+
+			readEnd.reset( ::CreateNamedPipe( name.c_str()
+											, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE
+											, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS
+											, 1
+											, 0
+											, OUTPUT_PIPE_SIZE
+											, 0
+											, null ) );
+
+			if ( readEnd.get() == nullhandle )
+			{
+				readEnd.release();
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateNamedPipe", "Failed. (0x%08x)", ::GetLastError() ) );
+			}
+
+			SECURITY_ATTRIBUTES sa = { sizeof( SECURITY_ATTRIBUTES ), null, TRUE };
+
+			writeEnd.reset( ::CreateFile( name.c_str(), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null ) );
+
+			if ( writeEnd.get() == nullhandle )
+			{
+				writeEnd.release();
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateFile", "Failed. (0x%08x)", ::GetLastError() ) );
+			}
+		}
+	}
+
+	namespace
+	{
+		// The handle is inheritable.
+		scoped_generic_handle OpenNulDevice( dword access )
+		{
+			SECURITY_ATTRIBUTES sa = { sizeof( SECURITY_ATTRIBUTES ), null, TRUE };
+			scoped_generic_handle device( ::CreateFile( _T( "NUL" ), access, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, null ) );
+
+			if ( device.get() == nullhandle )
+			{
+				device.release();
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateFile", "Failed. (0x%08x)", ::GetLastError() ) );
+			}
+
+			return device;
+		}
+
+		// The std handles must be inheritable. They are the only handles the child inherits,
+		// so pipes of processes started by other threads at the same time do not leak into it
+		// and keep those pipes open.
+		Process::Ptr LaunchWithStdHandles( const string_t& cmdline, handle_t stdIn, handle_t stdOut, handle_t stdErr, const path_t& appCurrentDir, void* envVariables, int creationFlags, int cmdShow )
+		{
+			handle_t inherited[] = { stdIn, stdOut, stdErr };
+			dword inheritedCount = ( stdErr == stdOut ) ? 2 : 3;
+
+			SIZE_T attributeSize = 0;
+			::InitializeProcThreadAttributeList( null, 1, 0, &attributeSize );
+
+			auto attributeBuffer = std::make_unique< byte[] >( attributeSize );
+			auto attributeList = reinterpret_cast< LPPROC_THREAD_ATTRIBUTE_LIST >( attributeBuffer.get() );
+
+			if ( ::InitializeProcThreadAttributeList( attributeList, 1, 0, &attributeSize ) == FALSE )
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "InitializeProcThreadAttributeList", "Failed. (0x%08x)", ::GetLastError() ) );
+
+			std::unique_ptr< std::remove_pointer_t< LPPROC_THREAD_ATTRIBUTE_LIST >, decltype( &::DeleteProcThreadAttributeList ) >
+				attributes( attributeList, &::DeleteProcThreadAttributeList );
+
+			if ( ::UpdateProcThreadAttribute( attributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited, inheritedCount * sizeof( handle_t ), null, null ) == FALSE )
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "UpdateProcThreadAttribute", "Failed. (0x%08x)", ::GetLastError() ) );
+
+			STARTUPINFOEX si;
+
+			Fill0( si );
+			si.StartupInfo.cb = sizeof( STARTUPINFOEX );
+			si.StartupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
+			si.StartupInfo.wShowWindow = static_cast< WORD >( cmdShow );
+			si.StartupInfo.hStdInput = stdIn;
+			si.StartupInfo.hStdOutput = stdOut;
+			si.StartupInfo.hStdError = stdErr;
+			si.lpAttributeList = attributeList;
+
+			return std::make_shared< Process >(
+				Process::Data( LaunchProcess( cmdline, appCurrentDir, envVariables, creationFlags | EXTENDED_STARTUPINFO_PRESENT, true, &si.StartupInfo ) ) );
+		}
+	}
+
+	Process::Ptr Process::Create( const string_t& cmdline, const path_t& appCurrentDir, void* envVariables, int creationFlags, bool inheritHandle, int cmdShow )
+	{
+		STARTUPINFO si;
+
+		si.cb = Fill0( si );
+		si.dwFlags = STARTF_USESHOWWINDOW;
+		si.wShowWindow = cmdShow;
+
+		return std::make_shared< Process >( Data( LaunchProcess( cmdline, appCurrentDir, envVariables, creationFlags, inheritHandle, &si ) ) );
+	}
+
+	Process::Ptr Process::Create( const string_t& cmdline, OutputPipes& pipes, bool mergeStdErr, const path_t& appCurrentDir, void* envVariables, int creationFlags, int cmdShow )
+	{
+		OutputPipes readEnds;
+		scoped_generic_handle stdOut;
+		scoped_generic_handle stdErr;
+
+		CreateOutputPipe( readEnds.stdOut, stdOut );
+
+		if ( !mergeStdErr )
+			CreateOutputPipe( readEnds.stdErr, stdErr );
+
+		scoped_generic_handle stdIn = OpenNulDevice( GENERIC_READ );
+
+		auto process = LaunchWithStdHandles( cmdline, stdIn.get(), stdOut.get(), ( mergeStdErr ) ? stdOut.get() : stdErr.get(), appCurrentDir, envVariables, creationFlags, cmdShow );
+
+		// The write ends now belong to the child. Closing ours lets the reads end when the child exits.
+		pipes = std::move( readEnds );
+
+		return process;
+	}
+
+	string_t Process::GetName() const
+	{
+		return m_data.GetProcessBaseName();
+	}
+
+	path_t Process::GetFileName() const
+	{
+		return m_data.GetProcessFileName();
+	}
+
+	handle_t Process::GetHandle() const
+	{
+		return m_data.GetProcessData().hProcess;
+	};
+
+	handle_t Process::GetPrimaryThreadHandle() const
+	{
+		return m_data.GetProcessData().hThread;
+	}
+
+	dword Process::GetId() const
+	{
+		return m_data.GetProcessData().dwProcessId;
+	}
+
+	dword Process::GetPrimaryThreadId() const
+	{
+		return m_data.GetProcessData().dwThreadId;
+	}
+
+	dword Process::GetExitCode() const
+	{
+		dword exitCode;
+
+		::GetExitCodeProcess( m_data.GetProcessData().hProcess, &exitCode );
+
+		return exitCode;
+	}
+
+	qword Process::GetCreationTime() const
+	{
+		return GetProcessCreationTime( m_data.GetProcessData().hProcess );
+	}
+
+	void Process::Terminate( int exitCode )
+	{
+		::TerminateProcess( m_data.GetProcessData().hProcess, exitCode );
+	}
+
+	std::size_t SuspendProcesses( const dword* pids, std::size_t count, bool suspend )
+	{
+		// A thread snapshot always lists the threads of the whole system; the pid argument is ignored.
+		scoped_generic_handle snapshot( ::CreateToolhelp32Snapshot( TH32CS_SNAPTHREAD, 0 ) );
+
+		if ( snapshot.get() == INVALID_HANDLE_VALUE )
+			return 0;
+
+		details::system_buffer< dword, 64 > targets;
+
+		targets.assign( pids, pids + count );
+
+		std::sort( targets.begin(), targets.end() );
+
+		dword currentThreadId = ::GetCurrentThreadId();
+		std::size_t changed = 0;
+
+		THREADENTRY32 thinfo;
+		thinfo.dwSize = Fill0( thinfo );
+
+		if ( ::Thread32First( snapshot.get(), &thinfo ) != FALSE )
+		{
+			do
+			{
+				if ( !std::binary_search( targets.begin(), targets.end(), thinfo.th32OwnerProcessID ) )
+					continue;
+
+				// Suspending the calling thread would never return.
+				if ( thinfo.th32ThreadID == currentThreadId )
+					continue;
+
+				scoped_generic_handle thread( ::OpenThread( THREAD_SUSPEND_RESUME, FALSE, thinfo.th32ThreadID ) );
+				if ( thread )
+				{
+					dword result = ( suspend ) ? ::SuspendThread( thread.get() ) : ::ResumeThread( thread.get() );
+
+					// Both return the previous suspend count. Resuming a thread whose count was 0 changes nothing.
+					if ( result != static_cast< dword >( -1 ) && ( suspend || result > 0 ) )
+						++changed;
+				}
+			}
+			while ( ::Thread32Next( snapshot.get(), &thinfo ) != FALSE );
+		}
+
+		return changed;
+	}
+
+	std::size_t SuspendProcesses( const std::vector< processptr_t >& processes, bool suspend )
+	{
+		details::system_buffer< dword, 64 > pids;
+
+		for ( const auto& process : processes )
+		{
+			if ( process )
+				pids.push_back( process->GetId() );
+		}
+
+		return SuspendProcesses( pids.data(), pids.size(), suspend );
+	}
+
+	void Process::Suspend()
+	{
+		dword pid = m_data.GetProcessData().dwProcessId;
+		SuspendProcesses( &pid, 1, true );
+	}
+
+	void Process::Resume()
+	{
+		dword pid = m_data.GetProcessData().dwProcessId;
+		SuspendProcesses( &pid, 1, false );
+	}
+
+	dword Process::Wait( dword milliseconds, bool forInputIdle ) const
+	{
+		if ( forInputIdle )
+			return ::WaitForInputIdle( m_data.GetProcessData().hProcess, milliseconds );
+		else
+			return ::WaitForSingleObject( m_data.GetProcessData().hProcess, milliseconds );
+	}
+
+	namespace
+	{
+		// The end given to the child is inheritable, the other one is not.
+		void CreateWorkerPipe( scoped_generic_handle& readEnd, scoped_generic_handle& writeEnd, bool childReads )
+		{
+			handle_t r = null;
+			handle_t w = null;
+
+			if ( ::CreatePipe( &r, &w, null, 0 ) == FALSE )
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "CreatePipe", "Failed. (0x%08x)", ::GetLastError() ) );
+
+			readEnd.reset( r );
+			writeEnd.reset( w );
+
+			if ( ::SetHandleInformation( ( childReads ) ? r : w, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT ) == FALSE )
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "SetHandleInformation", "Failed. (0x%08x)", ::GetLastError() ) );
+		}
+
+		bool WriteAll( handle_t h, const byte* data, std::size_t size )
+		{
+			while ( size > 0 )
+			{
+				dword written = 0;
+
+				if ( ::WriteFile( h, data, static_cast< dword >( std::min< std::size_t >( size, 0x10000 ) ), &written, null ) == FALSE )
+					return false;
+
+				data += written;
+				size -= written;
+			}
+
+			return true;
+		}
+
+		bool ReadAll( handle_t h, byte* data, std::size_t size )
+		{
+			while ( size > 0 )
+			{
+				dword read = 0;
+
+				if ( ::ReadFile( h, data, static_cast< dword >( std::min< std::size_t >( size, 0x10000 ) ), &read, null ) == FALSE || read == 0 )
+					return false;
+
+				data += read;
+				size -= read;
+			}
+
+			return true;
+		}
+
+		bool WriteMessage( handle_t h, const std::vector< byte >& message )
+		{
+			if ( message.size() > std::numeric_limits< ulong >::max() )
+				return false;
+
+			ulong size = static_cast< ulong >( message.size() );
+			byte header[4] = { static_cast< byte >( size ), static_cast< byte >( size >> 8 ), static_cast< byte >( size >> 16 ), static_cast< byte >( size >> 24 ) };
+
+			return WriteAll( h, header, sizeof( header ) ) && WriteAll( h, message.data(), message.size() );
+		}
+
+		bool ReadMessage( handle_t h, std::vector< byte >& message )
+		{
+			byte header[4];
+
+			if ( !ReadAll( h, header, sizeof( header ) ) )
+				return false;
+
+			ulong size = header[0] | ( header[1] << 8 ) | ( header[2] << 16 ) | ( static_cast< ulong >( header[3] ) << 24 );
+
+			message.resize( size );
+
+			return ReadAll( h, message.data(), message.size() );
+		}
+
+		// Time a worker gets to exit after its stdin has been closed.
+		constexpr dword WORKER_EXIT_TIMEOUT = 1000;
+
+		// Terminates a worker that did not answer in time. Its pipes break,
+		// so the dispatcher blocked writing or reading the job returns with a failure.
+		struct WorkerWatchdog
+		{
+			Process* process;
+			std::atomic< bool > fired;
+		};
+
+		void CALLBACK TerminateHungWorker( void* context, BOOLEAN )
+		{
+			WorkerWatchdog* watchdog = static_cast< WorkerWatchdog* >( context );
+
+			watchdog->fired.store( true, std::memory_order_relaxed );
+			watchdog->process->Terminate( 1 );
+		}
+	}
+
+	struct process_pool::job
+	{
+		message_t request;
+		std::promise< message_t > reply;
+	};
+
+	struct process_pool::slot
+	{
+		// Used only by the dispatcher of the slot.
+		scoped_generic_handle input;	// write end of the worker's stdin
+		scoped_generic_handle output;	// read end of the worker's stdout
+		std::thread dispatcher;
+
+		// Guarded by m_lock.
+		processptr_t process;
+		bool exited = false;
+		std::size_t jobsSinceStart = 0;
+		std::size_t jobs = 0;
+		std::size_t failures = 0;
+		std::size_t starts = 0;
+		std::chrono::steady_clock::time_point startTime;
+		std::chrono::steady_clock::duration busy = {};
+	};
+
+	process_pool::process_pool( const string_t& cmdline, std::size_t workers, std::size_t maxJobsPerWorker, dword jobTimeout )
+		: m_cmdline( cmdline )
+		, m_maxJobsPerWorker( maxJobsPerWorker )
+		, m_jobTimeout( jobTimeout )
+	{
+		m_waiter.set_callback(
+			[this] ( const processptr_t& process )
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+
+			for ( auto& w : m_slots )
+			{
+				if ( w->process == process )
+				{
+					w->exited = true;
+					m_changed.notify_all();
+					break;
+				}
+			}
+		} );
+
+		for ( std::size_t i = 0; i < workers; ++i )
+			m_slots.push_back( std::make_unique< slot >() );
+
+		try
+		{
+			// Workers are started before any dispatcher runs, so a bad command line is reported here.
+			// If one fails, the workers already started are stopped below.
+			for ( auto& w : m_slots )
+				start( *w );
+
+			for ( auto& w : m_slots )
+				w->dispatcher = std::thread( &process_pool::dispatch, this, std::ref( *w ) );
+		}
+		catch ( ... )
+		{
+			{
+				std::lock_guard< std::mutex > lock( m_lock );
+				m_stopping = true;
+			}
+
+			m_changed.notify_all();
+
+			for ( auto& w : m_slots )
+			{
+				if ( w->dispatcher.joinable() )
+					w->dispatcher.join();
+
+				stop( *w, true );
+			}
+
+			throw;
+		}
+	}
+
+	process_pool::~process_pool()
+	{
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_stopping = true;
+		}
+
+		m_changed.notify_all();
+
+		// A running job is finished first.
+		for ( auto& w : m_slots )
+		{
+			if ( w->dispatcher.joinable() )
+				w->dispatcher.join();
+		}
+
+		for ( auto& w : m_slots )
+			w->input.reset();
+
+		for ( auto& w : m_slots )
+			stop( *w, false );
+	}
+
+	std::future< process_pool::message_t > process_pool::submit( message_t request )
+	{
+		job j { std::move( request ), std::promise< message_t >() };
+		auto reply = j.reply.get_future();
+
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_queue.push_back( std::move( j ) );
+		}
+
+		m_changed.notify_one();
+
+		return reply;
+	}
+
+	std::size_t process_pool::queue_depth() const
+	{
+		std::lock_guard< std::mutex > lock( m_lock );
+		return m_queue.size();
+	}
+
+	std::vector< process_pool_worker_stats > process_pool::stats() const
+	{
+		std::vector< process_pool_worker_stats > result;
+		auto now = std::chrono::steady_clock::now();
+
+		std::lock_guard< std::mutex > lock( m_lock );
+
+		for ( const auto& w : m_slots )
+		{
+			double utilization = 0;
+
+			if ( w->process )
+			{
+				auto lifetime = now - w->startTime;
+
+				if ( lifetime.count() > 0 )
+					utilization = std::min( 1.0, std::chrono::duration< double >( w->busy ) / std::chrono::duration< double >( lifetime ) );
+			}
+
+			result.push_back(
+			{
+				( w->process ) ? w->process->GetId() : 0,
+				w->jobs,
+				w->failures,
+				( w->starts > 0 ) ? w->starts - 1 : 0,
+				utilization
+			} );
+		}
+
+		return result;
+	}
+
+	void process_pool::dispatch( slot& w )
+	{
+		while ( true )
+		{
+			job j;
+			bool hasJob = false;
+			bool needsWorker = false;
+
+			{
+				std::unique_lock< std::mutex > lock( m_lock );
+
+				m_changed.wait( lock, [this, &w] () { return ( m_stopping || !m_queue.empty() || w.exited ); } );
+
+				if ( m_stopping )
+					return;
+
+				if ( !m_queue.empty() )
+				{
+					j = std::move( m_queue.front() );
+					m_queue.pop_front();
+					hasJob = true;
+				}
+
+				needsWorker = ( !w.process || w.exited );
+			}
+
+			// A worker that exited by itself is replaced at once, so the pool stays warm.
+			if ( needsWorker )
+			{
+				stop( w, true );
+
+				try
+				{
+					start( w );
+				}
+				catch ( ... )
+				{
+					if ( hasJob )
+						j.reply.set_exception( std::current_exception() );
+
+					continue;
+				}
+			}
+
+			if ( !hasJob )
+				continue;
+
+			processptr_t process;
+
+			{
+				std::lock_guard< std::mutex > lock( m_lock );
+				process = w.process;
+			}
+
+			WorkerWatchdog watchdog { process.get(), false };
+			handle_t timer = null;
+
+			if ( m_jobTimeout != INFINITE
+				&& ::CreateTimerQueueTimer( &timer, null, &TerminateHungWorker, &watchdog, m_jobTimeout, 0, WT_EXECUTEONLYONCE ) == FALSE )
+			{
+				j.reply.set_exception( std::make_exception_ptr( std::runtime_error( "process_pool: CreateTimerQueueTimer failed; the job was not run." ) ) );
+				continue;
+			}
+
+			auto begin = std::chrono::steady_clock::now();
+
+			message_t reply;
+			bool succeeded = false;
+
+			try
+			{
+				succeeded = WriteMessage( w.input.get(), j.request ) && ReadMessage( w.output.get(), reply );
+			}
+			catch ( const std::bad_alloc& )
+			{
+				// A broken worker may announce any size.
+			}
+
+			// Waits for a callback that is running, so watchdog outlives it.
+			if ( timer != null )
+				::DeleteTimerQueueTimer( null, timer, INVALID_HANDLE_VALUE );
+
+			bool timedOut = watchdog.fired.load( std::memory_order_relaxed );
+
+			if ( timedOut )
+				succeeded = false;
+
+			auto end = std::chrono::steady_clock::now();
+			bool recycle = false;
+
+			{
+				std::lock_guard< std::mutex > lock( m_lock );
+
+				w.busy += end - begin;
+
+				if ( succeeded )
+				{
+					++w.jobs;
+					++w.jobsSinceStart;
+					recycle = ( m_maxJobsPerWorker != 0 && w.jobsSinceStart >= m_maxJobsPerWorker );
+				}
+				else
+				{
+					++w.failures;
+				}
+			}
+
+			if ( succeeded )
+			{
+				j.reply.set_value( std::move( reply ) );
+			}
+			else
+			{
+				j.reply.set_exception( std::make_exception_ptr( std::runtime_error( ( timedOut )
+					? "process_pool: the job timed out, and the worker was terminated."
+					: "process_pool: the worker failed while running the job." ) ) );
+				recycle = true;
+			}
+
+			if ( recycle )
+			{
+				stop( w, !succeeded );
+
+				{
+					// The destructor stops the workers; a new one is not started for it.
+					std::lock_guard< std::mutex > lock( m_lock );
+
+					if ( m_stopping )
+						return;
+				}
+
+				try
+				{
+					start( w );
+				}
+				catch ( ... )
+				{
+					// Retried when the next job arrives.
+				}
+			}
+		}
+	}
+
+	void process_pool::start( slot& w )
+	{
+		scoped_generic_handle childInput;
+		scoped_generic_handle parentInput;
+		scoped_generic_handle parentOutput;
+		scoped_generic_handle childOutput;
+
+		CreateWorkerPipe( childInput, parentInput, true );
+		CreateWorkerPipe( parentOutput, childOutput, false );
+
+		scoped_generic_handle errors = OpenNulDevice( GENERIC_WRITE );
+
+		// The child ends are closed when this returns, so a read fails as soon as the worker exits.
+		auto process = LaunchWithStdHandles( m_cmdline, childInput.get(), childOutput.get(), errors.get(), null, null, 0, SW_HIDE );
+
+		w.input = std::move( parentInput );
+		w.output = std::move( parentOutput );
+
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+
+			w.process = process;
+			w.exited = false;
+			w.jobsSinceStart = 0;
+			w.startTime = std::chrono::steady_clock::now();
+			w.busy = {};
+			++w.starts;
+		}
+
+		m_waiter.add( process );
+	}
+
+	void process_pool::stop( slot& w, bool force )
+	{
+		processptr_t process;
+
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			process = std::move( w.process );
+			w.exited = false;
+		}
+
+		// The worker is asked to exit by the end of its stdin.
+		w.input.reset();
+
+		if ( process )
+		{
+			m_waiter.remove( process );
+
+			if ( force || process->Wait( WORKER_EXIT_TIMEOUT ) != WAIT_OBJECT_0 )
+				process->Terminate( 1 );
+		}
+
+		w.output.reset();
+	}
+
+	struct process_stats::series
+	{
+		processptr_t process;
+		std::unique_ptr< process_sample[] > ring;
+		std::size_t next = 0;	// slot of the next sample
+		std::size_t count = 0;
+	};
+
+	namespace
+	{
+		inline qword FileTimeToQword( const FILETIME& ft )
+		{
+			return ( static_cast< qword >( ft.dwHighDateTime ) << 32 ) | ft.dwLowDateTime;
+		}
+
+		// Fields that cannot be queried are left 0.
+		void SampleProcess( handle_t process, process_sample& sample )
+		{
+			sample = {};
+			sample.time = std::chrono::steady_clock::now();
+
+			FILETIME creationTime, exitTime, kernelTime, userTime;
+
+			if ( ::GetProcessTimes( process, &creationTime, &exitTime, &kernelTime, &userTime ) != FALSE )
+			{
+				sample.kernelTime = FileTimeToQword( kernelTime );
+				sample.userTime = FileTimeToQword( userTime );
+			}
+
+			PROCESS_MEMORY_COUNTERS_EX memory;
+
+			if ( ::GetProcessMemoryInfo( process, reinterpret_cast< PROCESS_MEMORY_COUNTERS* >( &memory ), Fill0( memory ) ) != FALSE )
+			{
+				sample.workingSet = memory.WorkingSetSize;
+				sample.privateBytes = memory.PrivateUsage;
+				sample.pageFaults = memory.PageFaultCount;
+			}
+
+			IO_COUNTERS io;
+
+			if ( ::GetProcessIoCounters( process, &io ) != FALSE )
+			{
+				sample.readBytes = io.ReadTransferCount;
+				sample.writeBytes = io.WriteTransferCount;
+				sample.otherBytes = io.OtherTransferCount;
+			}
+		}
+	}
+
+	process_stats::process_stats( std::chrono::milliseconds interval, std::size_t history )
+		: m_history( std::max< std::size_t >( history, 1 ) )
+		, m_interval( interval )
+	{
+		// A zero interval would make the sampler spin.
+		if ( interval.count() <= 0 )
+			exception< std::invalid_argument >( ERROR_MSG( "interval must be positive" ) );
+
+		m_sampler = std::thread( &process_stats::run, this );
+	}
+
+	process_stats::~process_stats()
+	{
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_stopping = true;
+		}
+
+		m_changed.notify_all();
+		m_sampler.join();
+	}
+
+	void process_stats::add( const processptr_t& process )
+	{
+		// The ring is allocated here, so sampling never allocates.
+		auto s = std::make_shared< series >();
+
+		s->process = process;
+		s->ring = std::make_unique< process_sample[] >( m_history );
+
+		std::lock_guard< std::mutex > lock( m_lock );
+
+		for ( const auto& e : m_series )
+		{
+			if ( e->process == process )
+				return;
+		}
+
+		m_series.push_back( std::move( s ) );
+	}
+
+	void process_stats::remove( const processptr_t& process )
+	{
+		// A pass that is running may still hold the series. It is freed by whichever lets it go last.
+		std::shared_ptr< series > removed;
+
+		std::lock_guard< std::mutex > lock( m_lock );
+
+		auto it = std::find_if( m_series.begin(), m_series.end(),
+			[&process] ( const auto& e ) { return ( e->process == process ); } );
+
+		if ( it != m_series.end() )
+		{
+			removed = std::move( *it );
+			m_series.erase( it );
+		}
+	}
+
+	void process_stats::set_interval( std::chrono::milliseconds interval )
+	{
+		if ( interval.count() <= 0 )
+			exception< std::invalid_argument >( ERROR_MSG( "interval must be positive" ) );
+
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_interval = interval;
+		}
+
+		m_changed.notify_all();
+	}
+
+	void process_stats::sample_now()
+	{
+		sample_all();
+	}
+
+	std::size_t process_stats::samples( dword pid, process_sample* out, std::size_t count ) const
+	{
+		std::lock_guard< std::mutex > lock( m_lock );
+
+		for ( const auto& e : m_series )
+		{
+			if ( e->process->GetId() != pid )
+				continue;
+
+			std::size_t n = std::min( count, e->count );
+			std::size_t first = ( e->next + m_history - n ) % m_history;
+
+			for ( std::size_t i = 0; i < n; ++i )
+				out[i] = e->ring[( first + i ) % m_history];
+
+			return n;
+		}
+
+		return 0;
+	}
+
+	std::vector< process_sample > process_stats::samples( dword pid ) const
+	{
+		std::vector< process_sample > result( m_history );
+
+		result.resize( samples( pid, result.data(), result.size() ) );
+
+		return result;
+	}
+
+	bool process_stats::latest( dword pid, process_sample& sample ) const
+	{
+		return ( samples( pid, &sample, 1 ) == 1 );
+	}
+
+	// Called without m_lock. The kernel queries run without it; m_lock is taken only to copy
+	// the list of series and to publish each sample, so readers and add()/remove() do not wait for a pass.
+	// m_pass keeps its capacity, so copying the list does not allocate once it has grown.
+	void process_stats::sample_all()
+	{
+		std::lock_guard< std::mutex > passLock( m_passLock );
+
+		{
+			std::lock_guard< std::mutex > lock( m_lock );
+			m_pass.assign( m_series.begin(), m_series.end() );
+		}
+
+		for ( const auto& e : m_pass )
+		{
+			process_sample sample;
+			SampleProcess( e->process->GetHandle(), sample );
+
+			std::lock_guard< std::mutex > lock( m_lock );
+
+			e->ring[e->next] = sample;
+			e->next = ( e->next + 1 ) % m_history;
+			e->count = std::min( e->count + 1, m_history );
+		}
+
+		m_pass.clear();
+	}
+
+	void process_stats::run()
+	{
+		std::unique_lock< std::mutex > lock( m_lock );
+		auto due = std::chrono::steady_clock::now();
+
+		while ( !m_stopping )
+		{
+			lock.unlock();
+			sample_all();
+			lock.lock();
+
+			// Ticks are kept on a fixed grid, so a slow pass does not shift the ones after it.
+			due += m_interval;
+
+			auto now = std::chrono::steady_clock::now();
+			if ( due < now )
+				due = now;
+
+			auto interval = m_interval;
+
+			while ( m_changed.wait_until( lock, due, [this, &interval] () { return ( m_stopping || m_interval != interval ); } ) )
+			{
+				if ( m_stopping )
+					return;
+
+				// A new interval applies from the last sample.
+				due += m_interval - interval;
+				interval = m_interval;
+			}
+		}
+	}
+
+	namespace
+	{
+		// A handle keeps an exited process alive, but its pid may already belong to another process.
+		// So the process is accepted only while it is running,
+		// and, if creationTime is not 0, only if it was created at that time.
+		inline processptr_t OpenRunningProcess( dword pid, qword creationTime )
+		{
+			scoped_generic_handle process( OpenProcessStandardRightsOrLimitedRights( 0, false, pid ) );
+
+			if ( !process || ::WaitForSingleObject( process.get(), 0 ) != WAIT_TIMEOUT )
+				return null;
+
+			if ( creationTime != 0 && GetProcessCreationTime( process.get() ) != creationTime )
+				return null;
+
+			return std::make_shared< Process >( Process::Data( { process.release(), null, pid, 0 } ) );
+		}
+	}
+
+	processptr_t GetProcess( dword pid )
+	{
+		return OpenRunningProcess( pid, 0 );
+	}
+
+	processptr_t GetProcess( dword pid, qword creationTime )
+	{
+		return OpenRunningProcess( pid, creationTime );
+	}
+
+	std::vector< processptr_t > GetProcesses( const dword* pids, std::size_t count )
+	{
+		static adaptive_load_hint hint( _T( "GetProcesses/EnumProcesses" ) );
+		details::system_buffer< dword, 400 > running( 400 );
+		std::size_t runningCount = LoadProcessIds( running, hint );
+
+		std::sort( running.begin(), running.begin() + runningCount );
+
+		std::vector< processptr_t > result( count );
+
+		for ( std::size_t i = 0; i < count; ++i )
+		{
+			if ( std::binary_search( running.begin(), running.begin() + runningCount, pids[i] ) )
+				result[i] = OpenRunningProcess( pids[i], 0 );
+		}
+
+		return result;
+	}
+
+	processptr_t GetProcess( handle_t hProcess )
+	{
+		return std::make_shared< Process >( Process::Data( { hProcess, null, ::GetProcessId( hProcess ), 0 } ) );
+	}
+
+	path_t FindFilePath( const string_t& filename, const string_t& ext )
+	{
+		static adaptive_load_hint hint( _T( "FindFilePath" ) );
+		details::system_buffer< char_t, MAX_PATH > szSearchPath( MAX_PATH );
+
+		adaptive_load( szSearchPath, szSearchPath.size(), hint,
+			[&filename, &ext] ( char_t* s, std::size_t n )
+		{
+			return ::SearchPath( null, filename.c_str(), ( !ext.empty() ) ? ext.c_str() : null, numeric_cast< dword >( n ), s, null );
+		} );
+
+		return szSearchPath.data();
+	}
+
+	int RunElevated( const path_t& file, const string_t& parameters, bool waitForExit, int cmdShow )
+	{
+		path_t filePath = ComplatePath( file );
+
+		string_t fileInfo = to_string_t( filePath.filename() );
+		string_t directoryInfo = to_string_t( filePath.parent_path() );
+
+		SHELLEXECUTEINFO shei;
+
+		shei.cbSize = Fill0( shei );
+		shei.lpVerb = _T( "runas" );
+		shei.lpFile = fileInfo.c_str();
+		shei.lpDirectory = directoryInfo.c_str();
+		shei.lpParameters = parameters.c_str();
+		shei.nShow = cmdShow;
+
+		if ( waitForExit )
+			shei.fMask |= SEE_MASK_NOCLOSEPROCESS;
+
+		::ShellExecuteEx( &shei );
+
+		if ( shei.hProcess != null )
+		{
+			::WaitForSingleObject( shei.hProcess, INFINITE );
+
+			dword dwExitCode;
+			::GetExitCodeProcess( shei.hProcess, &dwExitCode );
+
+			::CloseHandle( shei.hProcess );
+
+			return static_cast< int >( dwExitCode );
+		}
+
+		int result = pointer_int_cast< int >( shei.hInstApp );
+
+		return ( result <= 32 ) ? result : 0;
+	}
+
+	namespace
+	{
+		typedef details::system_buffer< char_t, 256 > window_text_buffer;
+
+		struct FINDWINDOWINFO
+		{
+			static constexpr std::size_t BUFFER_SIZE = 256;
+			HWND hwnd;
+			DWORD pid;
+			LPCTSTR className;
+			LPCTSTR windowName;
+			window_text_buffer buffer;
+			bool found;
+		};
+
+		inline std::size_t GetWindowClassName( HWND hwnd, window_text_buffer& buffer )
+		{
+			return adaptive_load( buffer, buffer.size(),
+				[&hwnd] ( char_t* s, std::size_t n )
+			{
+				return ::GetClassName( hwnd, s, numeric_cast< int >( n ) );
+			} );
+		}
+
+		inline std::size_t GetWindowName( HWND hwnd, window_text_buffer& buffer )
+		{
+			std::size_t size = ::GetWindowTextLength( hwnd ) + 1;
+
+			if ( buffer.size() < size )
+				buffer.resize( size );
+
+			return ::GetWindowText( hwnd, cstr_t( buffer ), numeric_cast< int >( buffer.size() ) );
+		}
+
+		BOOL CALLBACK EnumChildWindowsProc(
+			HWND hwnd,      // qEBhẼnh
+			LPARAM lParam   // AvP[V`̒l
+		)
+		{
+			FINDWINDOWINFO* p = pointer_int_cast< FINDWINDOWINFO* >( lParam );
+
+			GetWindowClassName( hwnd, p->buffer );
+			if ( ::_tcsicmp( cstr_t( p->buffer ), p->className ) == 0 )
+			{
+				GetWindowName( hwnd, p->buffer );
+				if ( p->windowName == null || ( p->windowName != null && ::_tcsicmp(cstr_t(p->buffer), p->windowName) == 0 ) )
+				{
+					p->hwnd = hwnd;
+					p->found = true;
+					return FALSE;
+				}
+			}
+
+			// Search recursively until you finish finding or enumerating.
+			if ( !p->found )
+				::EnumChildWindows( hwnd, &EnumChildWindowsProc, lParam );
+
+			return ( p->found ) ? FALSE : TRUE;
+		}
+			
+		BOOL CALLBACK EnumChildWindowsProcEntry(
+			HWND hwnd,      // qEBhẼnh
+			LPARAM lParam   // AvP[V`̒l
+		)
+		{
+			FINDWINDOWINFO* p = pointer_int_cast< FINDWINDOWINFO* >( lParam );
+
+			// First check the first value.
+			if ( EnumChildWindowsProc( hwnd, lParam ) == FALSE )
+				return FALSE;
+
+			// If not found, also look for child windows.
+			::EnumChildWindows( hwnd, &EnumChildWindowsProc, lParam );
+
+			return ( p->found ) ? FALSE : TRUE;
+		}
+
+		BOOL CALLBACK EnumWindowsProc(
+			HWND hwnd,      // eEBhẼnh
+			LPARAM lParam   // AvP[V`̒l
+		)
+		{
+			dword pid;
+			FINDWINDOWINFO* p = pointer_int_cast< FINDWINDOWINFO* >( lParam );
+
+			::GetWindowThreadProcessId( hwnd, &pid );
+			if ( pid == p->pid )
+			{
+				GetWindowClassName( hwnd, p->buffer );
+				if ( ::_tcsicmp( cstr_t( p->buffer ), p->className ) == 0 )
+				{
+					GetWindowName( hwnd, p->buffer );
+					if ( p->windowName == null || ( p->windowName != null && ::_tcsicmp( cstr_t( p->buffer ), p->windowName ) == 0 ) )
+					{
+						p->hwnd = hwnd;
+						p->found = true;
+						return FALSE;
+					}
+				}
+			}
+
+			return TRUE;
+		}
+	}
+
+	string_t Window::GetText() const
+	{
+		long_t nLength = ::SendMessage( m_hwnd, WM_GETTEXTLENGTH, 0, 0 );
+		window_text_buffer buffer( nLength + 1 );
+
+		::SendMessage( m_hwnd, WM_GETTEXT, numeric_cast< WPARAM >( buffer.size() ), reinterpret_cast< LPARAM >( cstr_t( buffer ) ) );
+
+		return cstr_t( buffer );
+	}
+
+	string_t Window::SetText( const string_t& text )
+	{
+		string_t old = this->GetText();
+
+		this->Send( WM_SETTEXT, 0, reinterpret_cast< long_t >( text.c_str() ) );
+
+		return old;
+	}
+
+	long_t Window::GetAttribute( int index ) const
+	{
+		return ::GetWindowLongPtr( m_hwnd, index );
+	}
+
+	long_t Window::SetAttribute( int index, long_t value )
+	{
+		return ::SetWindowLongPtr( m_hwnd, index, value );
+	}
+	
+	string_t Window::GetClassNameText() const
+	{
+		window_text_buffer buffer( FINDWINDOWINFO::BUFFER_SIZE );
+
+		GetWindowClassName( m_hwnd, buffer );
+
+		return cstr_t( buffer );
 	}
 
 	long_t Window::Send( uint msg, uint_t wparam, long_t lparam )
 	{
-		return ::SendMessage( m_hwnd, msg, wparam, lparam );
+		return ::SendMessage( m_hwnd, msg, wparam, lparam );
+	}
+
+	long_t Window::SendNotify( uint msg, uint_t wparam, long_t lparam )
+	{
+		return ::SendNotifyMessage( m_hwnd, msg, wparam, lparam );
+	}
+
+	std::pair< long_t, dword_t > Window::SendTimeout( uint msg, uint_t wparam, long_t lparam, uint flags, uint milliseconds )
+	{
+		dword_t msgResult = 0;
+		long_t result = ::SendMessageTimeout( m_hwnd, msg, wparam, lparam, flags, milliseconds, &msgResult );
+
+		return std::make_pair( result, msgResult );
+	}
+
+	long_t Window::Post( uint msg, uint_t wparam, long_t lparam )
+	{
+		return ::PostMessage( m_hwnd, msg, wparam, lparam );
+	}
+
+	Window::Ptr Window::GetParent() const
+	{
+		return std::make_shared< Window >( ::GetParent(m_hwnd) );
+	}
+
+	void Window::Close()
+	{
+		if ( ::IsWindow( m_hwnd ) != FALSE )
+			this->Send( WM_CLOSE, 0, 0 );
+	}
+
+	Window::Ptr Window::GetChild( const string_t& wndClassName, const string_t& wndName ) const
+	{
+		FINDWINDOWINFO fwi =
+		{
+			null,
+			0,
+			wndClassName.c_str(),
+			( !wndName.empty() ) ? wndName.c_str() : null,
+			window_text_buffer( FINDWINDOWINFO::BUFFER_SIZE ),
+			false
+		};
+
+		::EnumChildWindows( this->GetHandle(), &EnumChildWindowsProcEntry, pointer_int_cast< LPARAM >( &fwi ));
+
+		if ( !fwi.found )
+			return null;
+
+		return std::make_shared< Window >( fwi.hwnd );
+	}
+
+	wndptr_t FindProcessWindow( const processptr_t& process, const string_t& wndClassName, const string_t& wndName )
+	{
+		if ( !process )
+			return null;
+
+		FINDWINDOWINFO fwi =
+		{
+			null,
+			process->GetId(),
+			wndClassName.c_str(),
+			( !wndName.empty() ) ? wndName.c_str() : null,
+			window_text_buffer( FINDWINDOWINFO::BUFFER_SIZE ),
+			false
+		};
+
+		::EnumWindows( &EnumWindowsProc, pointer_int_cast< LPARAM >( &fwi ) );
+
+		if ( !fwi.found )
+			return null;
+
+		return std::make_shared< Window >( fwi.hwnd );
+	}
+
+	uint GetRegBinary( hkey_t parentKey, const string_t& subKey, const string_t& valueName, void* ptr, uint size )
+	{
+		hkey_t hk;
+
+		LSTATUS r = ::RegOpenKeyEx( parentKey, subKey.c_str(), 0, KEY_READ, &hk );
+		if ( r == ERROR_SUCCESS )
+		{
+			dword acquireSize = size;
+			scoped_reg_handle regHandle( hk );
+
+			r = ::RegQueryValueEx( hk, valueName.c_str(), null, null, null, &acquireSize );
+			if ( r == ERROR_SUCCESS  )
+			{
+				scoped_local_memory< byte > buffer;
+				byte* acquiredData = reinterpret_cast< byte* >( ptr );
+				
+				if ( acquireSize > size )
+				{
+					buffer = make_scoped_local_memory< byte >( LPTR, acquireSize );
+					acquiredData = buffer.get();
+				}
+
+				if ( ptr == null )
+					exception< std::logic_error >( ERROR_MSG( "ptr is null" ) );
+
+				r = ::RegQueryValueEx( hk, valueName.c_str(), null, null, acquiredData, &acquireSize );
+				if ( r == ERROR_SUCCESS )
+				{
+					uint copyBytes = std::min( static_cast< dword >( size ), acquireSize );
+
+					if ( ptr != acquiredData )
+						std::memcpy( ptr, acquiredData, copyBytes );
+
+					return copyBytes;
+				}
+			}
+		}
+
+		return 0;
+	}
+
+	namespace
+	{
+		template < typename Xword, dword REGTYPE >
+		inline Xword GetRegXword( hkey_t parentKey, const string_t& subKey, const string_t& valueName )
+		{
+			hkey_t hk;
+
+			LSTATUS r = ::RegOpenKeyEx( parentKey, subKey.c_str(), 0, KEY_READ, &hk );
+			if ( r == ERROR_SUCCESS )
+			{
+				Xword result;
+
+				dword size = sizeof( Xword );
+				dword dataType = REGTYPE;
+				scoped_reg_handle regHandle( hk );
+
+				r = ::RegQueryValueEx( hk, valueName.c_str(), null, &dataType, reinterpret_cast< byte* >( &result ), &size );
+				if ( r == ERROR_SUCCESS && dataType == REGTYPE && size == sizeof( Xword ) )
+					return result;
+			}
+
+			exception< std::runtime_error >( REGVALUE_ERROR( "GetRegXword", subKey, valueName, r ) );
+
+			return null;
+		}
+
+	}
+
+	dword GetRegDword( hkey_t parentKey, const string_t& subKey, const string_t& valueName )
+	{
+		return GetRegXword< dword, REG_DWORD >( parentKey, subKey, valueName );
+	}
+
+	qword GetRegQword( hkey_t parentKey, const string_t& subKey, const string_t& valueName )
+	{
+		return GetRegXword< qword, REG_QWORD >( parentKey, subKey, valueName );
+	}
+
+	string_t GetRegString( hkey_t parentKey, const string_t& subKey, const string_t& valueName )
+	{
+		hkey_t hk;
+
+		LSTATUS r = ::RegOpenKeyEx( parentKey, subKey.c_str(), 0, KEY_READ, &hk );
+		if ( r == ERROR_SUCCESS )
+		{
+			dword size = 0;
+			scoped_reg_handle regHandle( hk );
+			r = ::RegQueryValueEx( hk, valueName.c_str(), null, null, null, &size );
+			if ( r == ERROR_SUCCESS )
+			{
+				dword dataType;
+				details::system_buffer< byte, 512 > buffer( size );
+				r = ::RegQueryValueEx( hk, valueName.c_str(), null, &dataType, buffer.data(), &size );
+				if ( r == ERROR_SUCCESS )
+				{
+					switch ( dataType )
+					{
+					case REG_DWORD:
+						return strprintf( _T( "%I32u" ), *reinterpret_cast< dword* >( buffer.data() ) );
+
+					case REG_QWORD:
+						return strprintf( _T( "%I64u" ), *reinterpret_cast< qword* >( buffer.data() ) );
+
+					case REG_SZ:
+					case REG_EXPAND_SZ:
+						return { reinterpret_cast< char_t* >( buffer.data() ), ( buffer.size() / sizeof( char_t ) ) - 1 };
+
+					default:
+						;
+					}
+
+					return { buffer.begin(), buffer.end() };
+				}
+			}
+		}
+
+		exception< std::runtime_error >( REGVALUE_ERROR( "GetRegString", subKey, valueName, r ) );
+
+		return null;
+	}
+
+	void SetRegString( hkey_t parentKey, const string_t& subKey, const string_t& valueName, const string_t& value )
+	{
+		hkey_t hk;
+		dword disposition;
+
+		LSTATUS r = ::RegCreateKeyEx( parentKey, subKey.c_str(), 0, null, REG_OPTION_NON_VOLATILE, KEY_WRITE, null, &hk, &disposition );
+		if ( r == ERROR_SUCCESS )
+		{
+			scoped_reg_handle regHandle( hk );
+			r = ::RegSetValueEx( hk, valueName.c_str(), 0, REG_SZ, reinterpret_cast< const byte* >( value.c_str() ), numeric_cast< dword >( value.length() ) );
+			if ( r == ERROR_SUCCESS )
+				return ;
+		}
+
+		exception< std::runtime_error >( REGVALUE_ERROR( "SetRegString", subKey, valueName, r ) );
+	}
+
+	void SetRegBinary( hkey_t parentKey, const string_t& subKey, const string_t& valueName, uint type, const void* ptr, uint size )
+	{
+		hkey_t hk;
+		dword disposition;
+
+		LSTATUS r = ::RegCreateKeyEx( parentKey, subKey.c_str(), 0, null, REG_OPTION_NON_VOLATILE, KEY_WRITE, null, &hk, &disposition );
+		if ( r == ERROR_SUCCESS )
+		{
+			scoped_reg_handle regHandle( hk );
+			r = ::RegSetValueEx( hk, valueName.c_str(), 0, type, reinterpret_cast< const byte* >( ptr ), size );
+			if ( r == ERROR_SUCCESS )
+				return;
+		}
+
+		exception< std::runtime_error >( REGVALUE_ERROR( "SetRegBinary", subKey, valueName, r ) );
+	}
+
+	string_t GetIniString( const path_t& file, const string_t& section, const string_t& name, const string_t& defaultValue )
+	{
+		static adaptive_load_hint hint( _T( "GetIniString" ) );
+		details::system_buffer< char_t, 512 > buffer( 512 );
+
+		adaptive_load( buffer, buffer.size(), hint,
+			[&section, &name, &defaultValue, &file] ( char_t* s, std::size_t n ) 
+		{
+			dword r = ::GetPrivateProfileString( section.c_str()
+												 , name.c_str()
+												 , defaultValue.c_str()
+												 , s
+												 , numeric_cast< dword >( n )
+												 , to_string_t( file ).c_str() );
+			return ( r == n - 1 ) ? r + 1 : r;
+		} );
+
+		return cstr_t( buffer );
+	}
+
+	bool GetIniBinary( const path_t& file, const string_t& section, const string_t& name, void* ptr, uint size )
+	{
+		if ( ptr == null )
+			exception< std::logic_error >( ERROR_MSG( "ptr is null" ) );
+
+		return ( ::GetPrivateProfileStruct( section.c_str(), name.c_str(), ptr, size, to_string_t( file ).c_str() ) != FALSE );
+	}
+
+	void SetIniString( const path_t& file, const string_t& section, const string_t& name, const string_t& value )
+	{
+		LPCTSTR pszName = ( !name.empty() ) ? name.c_str() : null;
+		LPCTSTR pszValue = ( !value.empty() ) ? value.c_str() : null;
+
+		::WritePrivateProfileString( section.c_str(), pszName, pszValue, to_string_t( file ).c_str() );
+	}
+
+	void SetIniBinary( const path_t& file, const string_t& section, const string_t& name, const void* ptr, uint size )
+	{
+		LPCTSTR pszName = ( !name.empty() ) ? name.c_str() : null;
+
+		if ( ptr == null )
+			exception< std::logic_error >( ERROR_MSG( "ptr is null" ) );
+
+		::WritePrivateProfileStruct( section.c_str(), pszName, const_cast< void* >( ptr ), size, to_string_t( file ).c_str() );
+	}
+
+	namespace
+	{
+		std::wstring MultiByteToWide( uint codePage, const char* s, std::size_t length )
+		{
+			std::wstring text;
+
+			if ( length == 0 )
+				return text;
+
+			int r = ::MultiByteToWideChar( codePage, 0, s, numeric_cast< int >( length ), null, 0 );
+
+			if ( r == 0 )
+				exception< std::runtime_error >( FUNC_ERROR_ID( "MultiByteToWideChar", ::GetLastError() ) );
+
+			text.resize( r );
+			::MultiByteToWideChar( codePage, 0, s, numeric_cast< int >( length ), &text[0], r );
+
+			return text;
+		}
+
+		std::string WideToMultiByte( uint codePage, const std::wstring& text )
+		{
+			std::string bytes;
+
+			if ( text.empty() )
+				return bytes;
+
+			int length = numeric_cast< int >( text.size() );
+			int r = ::WideCharToMultiByte( codePage, 0, text.c_str(), length, null, 0, null, null );
+
+			if ( r == 0 )
+				exception< std::runtime_error >( FUNC_ERROR_ID( "WideCharToMultiByte", ::GetLastError() ) );
+
+			bytes.resize( r );
+			::WideCharToMultiByte( codePage, 0, text.c_str(), length, &bytes[0], r, null, null );
+
+			return bytes;
+		}
+
+		void AssignIniText( std::wstring& to, std::wstring&& from )
+		{
+			to = std::move( from );
+		}
+
+		void AssignIniText( std::string& to, std::wstring&& from )
+		{
+			to = WideToMultiByte( CP_ACP, from );
+		}
+
+		enum class IniEncoding
+		{
+			Ansi,
+			Utf16,
+			Utf8
+		};
+
+		// UTF-16LE with a BOM, UTF-8 with a BOM, otherwise the ANSI code page.
+		std::wstring DecodeIniFile( const std::vector< byte >& bytes, IniEncoding& encoding )
+		{
+			std::wstring wide;
+
+			if ( bytes.size() >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE )
+			{
+				encoding = IniEncoding::Utf16;
+				wide.resize( ( bytes.size() - 2 ) / sizeof( wchar_t ) );
+				std::memcpy( &wide[0], bytes.data() + 2, wide.size() * sizeof( wchar_t ) );
+			}
+			else if ( bytes.size() >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF )
+			{
+				encoding = IniEncoding::Utf8;
+				wide = MultiByteToWide( CP_UTF8, reinterpret_cast< const char* >( bytes.data() + 3 ), bytes.size() - 3 );
+			}
+			else
+			{
+				encoding = IniEncoding::Ansi;
+				wide = MultiByteToWide( CP_ACP, reinterpret_cast< const char* >( bytes.data() ), bytes.size() );
+			}
+
+			return wide;
+		}
+
+		string_t DecodeIniText( const std::vector< byte >& bytes, IniEncoding& encoding )
+		{
+			string_t text;
+			AssignIniText( text, DecodeIniFile( bytes, encoding ) );
+
+			return text;
+		}
+
+		std::wstring IniTextToWide( const std::wstring& text )
+		{
+			return text;
+		}
+
+		std::wstring IniTextToWide( const std::string& text )
+		{
+			return MultiByteToWide( CP_ACP, text.c_str(), text.size() );
+		}
+
+		std::vector< byte > EncodeIniFile( const std::wstring& wide, IniEncoding encoding )
+		{
+			std::vector< byte > bytes;
+
+			if ( encoding == IniEncoding::Utf16 )
+			{
+				bytes.resize( 2 + wide.size() * sizeof( wchar_t ) );
+				bytes[0] = 0xFF;
+				bytes[1] = 0xFE;
+				std::memcpy( bytes.data() + 2, wide.data(), wide.size() * sizeof( wchar_t ) );
+			}
+			else
+			{
+				bool utf8 = ( encoding == IniEncoding::Utf8 );
+				std::string encoded = WideToMultiByte( ( utf8 ) ? CP_UTF8 : CP_ACP, wide );
+
+				if ( utf8 )
+					bytes.insert( bytes.end(), { 0xEF, 0xBB, 0xBF } );
+
+				bytes.insert( bytes.end(), encoded.begin(), encoded.end() );
+			}
+
+			return bytes;
+		}
+
+		// GetPrivateProfileString() and WritePrivateProfileString() look for a name without a directory
+		// in the Windows directory, not in the current one. The same file must be read and written here.
+		path_t ResolveIniPath( const path_t& file )
+		{
+			if ( file.has_parent_path() )
+				return file;
+
+			static adaptive_load_hint hint( _T( "ResolveIniPath" ) );
+			details::system_buffer< char_t, MAX_PATH > buffer( MAX_PATH );
+
+			std::size_t length = adaptive_load( buffer, buffer.size(), hint,
+				[] ( char_t* buffer, std::size_t n )
+			{
+				return ::GetWindowsDirectory( buffer, numeric_cast< uint >( n ) );
+			} );
+
+			if ( length == 0 )
+				exception< std::runtime_error >( FUNC_ERROR_ID( "GetWindowsDirectory", ::GetLastError() ) );
+
+			return path_t( cstr_t( buffer ) ) / file;
+		}
+
+		// Returns false if the file could not be opened or read; GetLastError() tells why.
+		bool ReadIniFile( const path_t& file, std::vector< byte >& bytes )
+		{
+			scoped_generic_handle h( ::CreateFile( to_string_t( file ).c_str()
+												   , GENERIC_READ
+												   , FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE
+												   , null
+												   , OPEN_EXISTING
+												   , FILE_FLAG_SEQUENTIAL_SCAN
+												   , null ) );
+
+			if ( h.get() == nullhandle )
+			{
+				h.release();
+				return false;
+			}
+
+			LARGE_INTEGER size = {};
+
+			if ( ::GetFileSizeEx( h.get(), &size ) == FALSE )
+				return false;
+
+			bytes.resize( numeric_cast< std::size_t >( size.QuadPart ) );
+
+			return ReadAll( h.get(), bytes.data(), bytes.size() );
+		}
+
+		// Templates, because ini_transaction works on UTF-16 text in both builds.
+		template < typename Char >
+		inline bool IsIniSpace( Char c ) noexcept
+		{
+			return ( c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f' );
+		}
+
+		template < typename Char >
+		std::basic_string_view< Char > TrimIni( std::basic_string_view< Char > s ) noexcept
+		{
+			while ( !s.empty() && IsIniSpace( s.front() ) )
+				s.remove_prefix( 1 );
+
+			while ( !s.empty() && IsIniSpace( s.back() ) )
+				s.remove_suffix( 1 );
+
+			return s;
+		}
+
+		string_view_t UnquoteIni( string_view_t s ) noexcept
+		{
+			if ( s.size() >= 2 && ( s.front() == _T( '"' ) || s.front() == _T( '\'' ) ) && s.back() == s.front() )
+				return s.substr( 1, s.size() - 2 );
+
+			return s;
+		}
+
+		inline int HexDigit( char_t c ) noexcept
+		{
+			if ( c >= _T( '0' ) && c <= _T( '9' ) )
+				return c - _T( '0' );
+
+			if ( c >= _T( 'A' ) && c <= _T( 'F' ) )
+				return c - _T( 'A' ) + 10;
+
+			if ( c >= _T( 'a' ) && c <= _T( 'f' ) )
+				return c - _T( 'a' ) + 10;
+
+			return -1;
+		}
+
+		inline int HexByte( const char_t* s ) noexcept
+		{
+			int high = HexDigit( s[0] );
+			int low = HexDigit( s[1] );
+
+			return ( high < 0 || low < 0 ) ? -1 : ( high << 4 ) | low;
+		}
+
+		// The lookup key is folded as the index keys are: upper-cased by CharUpperBuff().
+		typedef small_vector< char_t, 256 > ini_key_t;
+
+		string_view_t FoldIniKey( ini_key_t& key, string_view_t section, const string_view_t* name )
+		{
+			key.resize( section.size() + ( ( name != null ) ? name->size() + 1 : 0 ) );
+
+			char_t* p = std::copy( section.begin(), section.end(), key.data() );
+
+			if ( name != null )
+			{
+				*p++ = _T( '\n' );
+				std::copy( name->begin(), name->end(), p );
+			}
+
+			if ( !key.empty() )
+				::CharUpperBuff( key.data(), numeric_cast< dword >( key.size() ) );
+
+			return { key.data(), key.size() };
+		}
+	}
+
+	ini_document::ini_document( const path_t& file )
+	{
+		load( file );
+	}
+
+	bool ini_document::load( const path_t& file )
+	{
+		m_text.reset();
+		m_folded.reset();
+		m_entries.clear();
+		m_sections.clear();
+		m_sectionIndex.clear();
+		m_entryIndex.clear();
+
+		std::vector< byte > bytes;
+		IniEncoding encoding;
+
+		if ( !ReadIniFile( ResolveIniPath( file ), bytes ) )
+			return false;
+
+		string_t text = DecodeIniText( bytes, encoding );
+
+		m_text = std::make_unique< char_t[] >( text.size() );
+		std::copy( text.begin(), text.end(), m_text.get() );
+
+		parse( text.size() );
+
+		return true;
+	}
+
+	void ini_document::parse( std::size_t length )
+	{
+		struct line_entry
+		{
+			std::size_t section;
+			string_view_t name;
+			string_view_t value;
+		};
+
+		string_view_t text( m_text.get(), length );
+		std::vector< string_view_t > headers;		// duplicates included
+		std::vector< line_entry > lines;
+		std::size_t foldedLength = 0;
+
+		while ( !text.empty() )
+		{
+			std::size_t end = text.find( _T( '\n' ) );
+			string_view_t line = TrimIni( text.substr( 0, end ) );
+
+			text.remove_prefix( ( end != string_view_t::npos ) ? end + 1 : text.size() );
+
+			if ( line.empty() || line.front() == _T( ';' ) )
+				continue;
+
+			if ( line.front() == _T( '[' ) )
+			{
+				std::size_t close = line.find( _T( ']' ) );
+
+				headers.push_back( TrimIni( line.substr( 1, ( close != string_view_t::npos ) ? close - 1 : string_view_t::npos ) ) );
+				foldedLength += headers.back().size();
+				continue;
+			}
+
+			// The profile API does not see lines before the first section either.
+			if ( headers.empty() )
+				continue;
+
+			std::size_t equal = line.find( _T( '=' ) );
+			string_view_t name = TrimIni( line.substr( 0, equal ) );
+			string_view_t value = ( equal != string_view_t::npos ) ? UnquoteIni( TrimIni( line.substr( equal + 1 ) ) ) : string_view_t();
+
+			lines.push_back( { headers.size() - 1, name, value } );
+			foldedLength += headers.back().size() + 1 + name.size();
+		}
+
+		// All the folded strings are written and upper-cased in one buffer before any view of them is taken.
+		m_folded = std::make_unique< char_t[] >( foldedLength );
+		char_t* out = m_folded.get();
+
+		for ( const auto& header : headers )
+			out = std::copy( header.begin(), header.end(), out );
+
+		for ( const auto& line : lines )
+		{
+			const string_view_t& header = headers[line.section];
+
+			out = std::copy( header.begin(), header.end(), out );
+			*out++ = _T( '\n' );
+			out = std::copy( line.name.begin(), line.name.end(), out );
+		}
+
+		if ( foldedLength > 0 )
+			::CharUpperBuff( m_folded.get(), numeric_cast< dword >( foldedLength ) );
+
+		const char_t* folded = m_folded.get();
+		std::vector< std::size_t > sectionOf( headers.size(), SIZE_MAX );		// SIZE_MAX for a duplicate header
+
+		m_sectionIndex.reserve( headers.size() );
+		m_entryIndex.reserve( lines.size() );
+		m_entries.reserve( lines.size() );
+
+		for ( std::size_t i = 0; i < headers.size(); ++i )
+		{
+			string_view_t key( folded, headers[i].size() );
+			folded += key.size();
+
+			if ( m_sectionIndex.emplace( key, m_sections.size() ).second )
+			{
+				sectionOf[i] = m_sections.size();
+				m_sections.push_back( { headers[i], {} } );
+			}
+		}
+
+		for ( const auto& line : lines )
+		{
+			string_view_t key( folded, headers[line.section].size() + 1 + line.name.size() );
+			folded += key.size();
+
+			std::size_t section = sectionOf[line.section];
+
+			if ( section == SIZE_MAX )
+				continue;
+
+			if ( m_entryIndex.emplace( key, m_entries.size() ).second )
+			{
+				m_sections[section].entries.push_back( m_entries.size() );
+				m_entries.push_back( { line.name, line.value } );
+			}
+		}
+	}
+
+	const ini_document::entry* ini_document::find( string_view_t section, string_view_t name ) const
+	{
+		ini_key_t key;
+		auto it = m_entryIndex.find( FoldIniKey( key, section, &name ) );
+
+		return ( it != m_entryIndex.end() ) ? &m_entries[it->second] : null;
+	}
+
+	bool ini_document::has_section( string_view_t section ) const
+	{
+		ini_key_t key;
+		return ( m_sectionIndex.find( FoldIniKey( key, section, null ) ) != m_sectionIndex.end() );
+	}
+
+	bool ini_document::contains( string_view_t section, string_view_t name ) const
+	{
+		return ( find( section, name ) != null );
+	}
+
+	string_view_t ini_document::get_string( string_view_t section, string_view_t name, string_view_t defaultValue ) const
+	{
+		const entry* e = find( section, name );
+		return ( e != null ) ? e->value : defaultValue;
+	}
+
+	bool ini_document::get_binary( string_view_t section, string_view_t name, void* ptr, uint size ) const
+	{
+		if ( ptr == null )
+			exception< std::logic_error >( ERROR_MSG( "ptr is null" ) );
+
+		const entry* e = find( section, name );
+
+		// Two hex digits for every byte, then two for the checksum, the low byte of their sum.
+		if ( e == null || e->value.size() != ( static_cast< std::size_t >( size ) + 1 ) * 2 )
+			return false;
+
+		const char_t* digits = e->value.data();
+		uint sum = 0;
+
+		for ( uint i = 0; i < size; ++i )
+		{
+			int b = HexByte( digits + i * 2 );
+
+			if ( b < 0 )
+				return false;
+
+			sum += static_cast< uint >( b );
+		}
+
+		if ( HexByte( digits + static_cast< std::size_t >( size ) * 2 ) != static_cast< int >( sum & 0xff ) )
+			return false;
+
+		byte* data = static_cast< byte* >( ptr );
+
+		for ( uint i = 0; i < size; ++i )
+			data[i] = static_cast< byte >( HexByte( digits + i * 2 ) );
+
+		return true;
+	}
+
+	std::vector< string_view_t > ini_document::sections() const
+	{
+		std::vector< string_view_t > names;
+		names.reserve( m_sections.size() );
+
+		for ( const auto& s : m_sections )
+			names.push_back( s.name );
+
+		return names;
+	}
+
+	std::vector< string_view_t > ini_document::keys( string_view_t section ) const
+	{
+		std::vector< string_view_t > names;
+		ini_key_t key;
+		auto it = m_sectionIndex.find( FoldIniKey( key, section, null ) );
+
+		if ( it == m_sectionIndex.end() )
+			return names;
+
+		const section_entry& s = m_sections[it->second];
+		names.reserve( s.entries.size() );
+
+		for ( std::size_t i : s.entries )
+			names.push_back( m_entries[i].name );
+
+		return names;
+	}
+
+	namespace
+	{
+		std::wstring FoldIniName( std::wstring_view name )
+		{
+			std::wstring folded( name );
+
+			if ( !folded.empty() )
+				::CharUpperBuffW( &folded[0], numeric_cast< dword >( folded.size() ) );
+
+			return folded;
+		}
+
+		// The line without its line break.
+		std::wstring_view IniLineBody( std::wstring_view raw ) noexcept
+		{
+			while ( !raw.empty() && ( raw.back() == L'\n' || raw.back() == L'\r' ) )
+				raw.remove_suffix( 1 );
+
+			return raw;
+		}
+	}
+
+	ini_transaction::ini_transaction( const path_t& file )
+		: m_file( ResolveIniPath( file ) )
+	{}
+
+	ini_transaction::section_edit& ini_transaction::edit_section( const std::wstring& section )
+	{
+		std::wstring key = FoldIniName( section );
+		auto it = m_sectionIndex.find( key );
+
+		if ( it != m_sectionIndex.end() )
+			return m_sections[it->second];
+
+		m_sections.push_back( { section } );
+		m_sectionIndex.emplace( std::move( key ), m_sections.size() - 1 );
+
+		return m_sections.back();
+	}
+
+	void ini_transaction::edit_key( const string_t& section, const string_t& name, std::optional< string_t > value )
+	{
+		section_edit& s = edit_section( IniTextToWide( section ) );
+		std::wstring wideName = IniTextToWide( name );
+		std::wstring key = FoldIniName( wideName );
+		std::optional< std::wstring > wideValue;
+
+		if ( value )
+			wideValue = IniTextToWide( *value );
+		auto it = s.keyIndex.find( key );
+
+		if ( it != s.keyIndex.end() )
+		{
+			s.keys[it->second].value = std::move( wideValue );
+			return;
+		}
+
+		s.keys.push_back( { std::move( wideName ), std::move( wideValue ) } );
+		s.keyIndex.emplace( std::move( key ), s.keys.size() - 1 );
 	}
 
-	long_t Window::SendNotify( uint msg, uint_t wparam, long_t lparam )
+	void ini_transaction::set_string( const string_t& section, const string_t& name, const string_t& value )
 	{
-		return ::SendNotifyMessage( m_hwnd, msg, wparam, lparam );
+		edit_key( section, name, value );
 	}
 
-	std::pair< long_t, dword_t > Window::SendTimeout( uint msg, uint_t wparam, long_t lparam, uint flags, uint milliseconds )
+	void ini_transaction::set_binary( const string_t& section, const string_t& name, const void* ptr, uint size )
 	{
-		dword_t msgResult = 0;
-		long_t result = ::SendMessageTimeout( m_hwnd, msg, wparam, lparam, flags, milliseconds, &msgResult );
+		if ( ptr == null )
+			exception< std::logic_error >( ERROR_MSG( "ptr is null" ) );
 
-		return std::make_pair( result, msgResult );
-	}
+		static const char_t digits[] = _T( "0123456789ABCDEF" );
 
-	long_t Window::Post( uint msg, uint_t wparam, long_t lparam )
-	{
-		return ::PostMessage( m_hwnd, msg, wparam, lparam );
+		const byte* data = static_cast< const byte* >( ptr );
+		string_t value;
+		uint sum = 0;
+
+		value.reserve( ( static_cast< std::size_t >( size ) + 1 ) * 2 );
+
+		auto put =
+			[&value] ( uint b )
+		{
+			value.push_back( digits[( b >> 4 ) & 0x0f] );
+			value.push_back( digits[b & 0x0f] );
+		};
+
+		for ( uint i = 0; i < size; ++i )
+		{
+			sum += data[i];
+			put( data[i] );
+		}
+
+		put( sum & 0xff );
+
+		edit_key( section, name, std::move( value ) );
 	}
 
-	Window::Ptr Window::GetParent() const
+	void ini_transaction::remove_key( const string_t& section, const string_t& name )
 	{
-		return std::make_shared< Window >( ::GetParent(m_hwnd) );
+		edit_key( section, name, std::nullopt );
 	}
 
-	void Window::Close()
+	void ini_transaction::remove_section( const string_t& section )
 	{
-		if ( ::IsWindow( m_hwnd ) != FALSE )
-			this->Send( WM_CLOSE, 0, 0 );
+		section_edit& s = edit_section( IniTextToWide( section ) );
+
+		s.removed = true;
+		s.keys.clear();
+		s.keyIndex.clear();
 	}
 
-	Window::Ptr Window::GetChild( const string_t& wndClassName, const string_t& wndName ) const
+	std::size_t ini_transaction::size() const noexcept
 	{
-		FINDWINDOWINFO fwi =
-		{
-			null,
-			0,
-			wndClassName.c_str(),
-			( !wndName.empty() ) ? wndName.c_str() : null,
-			vchar_t( FINDWINDOWINFO::BUFFER_SIZE ),
-			false
-		};
+		std::size_t n = 0;
 
-		::EnumChildWindows( this->GetHandle(), &EnumChildWindowsProcEntry, pointer_int_cast< LPARAM >( &fwi ));
+		for ( const auto& s : m_sections )
+			n += s.keys.size() + ( ( s.removed ) ? 1 : 0 );
 
-		if ( !fwi.found )
-			return null;
+		return n;
+	}
 
-		return std::make_shared< Window >( fwi.hwnd );
+	bool ini_transaction::empty() const noexcept
+	{
+		return ( size() == 0 );
 	}
 
-	wndptr_t FindProcessWindow( const processptr_t& process, const string_t& wndClassName, const string_t& wndName )
+	void ini_transaction::rollback() noexcept
 	{
-		if ( !process )
-			return null;
+		m_sections.clear();
+		m_sectionIndex.clear();
+	}
 
-		FINDWINDOWINFO fwi =
+	std::wstring ini_transaction::apply( std::wstring_view text ) const
+	{
+		std::wstring out;
+		std::wstring pending;		// blank and comment lines after the last key of the current section
+		const section_edit* current = null;		// the edits of the section being copied, at its first [section] only
+		bool skipping = false;		// inside a removed section
+		std::vector< bool > seen( m_sections.size() );
+		std::vector< std::vector< bool > > written( m_sections.size() );
+
+		for ( std::size_t i = 0; i < m_sections.size(); ++i )
+			written[i].resize( m_sections[i].keys.size() );
+
+		auto hasValues =
+			[] ( const section_edit& s )
 		{
-			null,
-			process->GetId(),
-			wndClassName.c_str(),
-			( !wndName.empty() ) ? wndName.c_str() : null,
-			vchar_t( FINDWINDOWINFO::BUFFER_SIZE ),
-			false
+			return std::any_of( s.keys.begin(), s.keys.end(), [] ( const key_edit& k ) { return k.value.has_value(); } );
 		};
 
-		::EnumWindows( &EnumWindowsProc, pointer_int_cast< LPARAM >( &fwi ) );
+		auto newLine =
+			[&out] ()
+		{
+			if ( !out.empty() && out.back() != L'\n' )
+				out += L"\r\n";
+		};
 
-		if ( !fwi.found )
-			return null;
+		auto writeKey =
+			[&out, &newLine] ( const key_edit& k )
+		{
+			newLine();
+			out.append( k.name ).append( 1, L'=' ).append( *k.value ).append( L"\r\n" );
+		};
 
-		return std::make_shared< Window >( fwi.hwnd );
-	}
+		// New keys go after the last key of the section, before the blank lines and comments that end it.
+		auto finishSection =
+			[&] ()
+		{
+			if ( current != null )
+			{
+				std::size_t id = static_cast< std::size_t >( current - m_sections.data() );
 
-	uint GetRegBinary( hkey_t parentKey, const string_t& subKey, const string_t& valueName, void* ptr, uint size )
-	{
-		hkey_t hk;
+				for ( std::size_t k = 0; k < current->keys.size(); ++k )
+				{
+					if ( current->keys[k].value && !written[id][k] )
+						writeKey( current->keys[k] );
+				}
+			}
 
-		LSTATUS r = ::RegOpenKeyEx( parentKey, subKey.c_str(), 0, KEY_READ, &hk );
-		if ( r == ERROR_SUCCESS )
+			out += pending;
+			pending.clear();
+		};
+
+		out.reserve( text.size() );
+
+		while ( !text.empty() )
 		{
-			dword acquireSize = size;
-			scoped_reg_handle regHandle( hk );
+			std::size_t end = text.find( L'\n' );
+			std::wstring_view raw = text.substr( 0, ( end != std::wstring_view::npos ) ? end + 1 : text.size() );
+			std::wstring_view body = IniLineBody( raw );
+			std::wstring_view line = TrimIni( body );
 
-			r = ::RegQueryValueEx( hk, valueName.c_str(), null, null, null, &acquireSize );
-			if ( r == ERROR_SUCCESS  )
+			text.remove_prefix( raw.size() );
+
+			if ( !line.empty() && line.front() == L'[' )
 			{
-				scoped_local_memory< byte > buffer;
-				byte* acquiredData = reinterpret_cast< byte* >( ptr );
-				
-				if ( acquireSize > size )
-				{
-					buffer = make_scoped_local_memory< byte >( LPTR, acquireSize );
-					acquiredData = buffer.get();
-				}
+				finishSection();
 
-				if ( ptr == null )
-					exception< std::logic_error >( ERROR_MSG( "ptr is null" ) );
+				std::size_t close = line.find( L']' );
+				std::wstring_view name = TrimIni( line.substr( 1, ( close != std::wstring_view::npos ) ? close - 1 : std::wstring_view::npos ) );
+				auto it = m_sectionIndex.find( FoldIniName( name ) );
+				const section_edit* edit = null;
+				bool first = false;
 
-				r = ::RegQueryValueEx( hk, valueName.c_str(), null, null, acquiredData, &acquireSize );
-				if ( r == ERROR_SUCCESS )
+				if ( it != m_sectionIndex.end() )
 				{
-					uint copyBytes = std::min( static_cast< dword >( size ), acquireSize );
+					edit = &m_sections[it->second];
+					first = !seen[it->second];
+					seen[it->second] = true;
+				}
 
-					if ( ptr != acquiredData )
-						std::memcpy( ptr, acquiredData, copyBytes );
+				current = ( first ) ? edit : null;
+				skipping = ( edit != null && edit->removed );
 
-					return copyBytes;
-				}
+				// A removed section keeps its place if keys were set in it again.
+				if ( !skipping || ( first && hasValues( *edit ) ) )
+					out += raw;
+
+				continue;
 			}
-		}
 
-		return 0;
-	}
+			if ( skipping )
+				continue;
 
-	namespace
-	{
-		template < typename Xword, dword REGTYPE >
-		inline Xword GetRegXword( hkey_t parentKey, const string_t& subKey, const string_t& valueName )
-		{
-			hkey_t hk;
+			if ( current == null )
+			{
+				out += raw;
+				continue;
+			}
 
-			LSTATUS r = ::RegOpenKeyEx( parentKey, subKey.c_str(), 0, KEY_READ, &hk );
-			if ( r == ERROR_SUCCESS )
+			if ( line.empty() || line.front() == L';' )
 			{
-				Xword result;
+				pending += raw;
+				continue;
+			}
 
-				dword size = sizeof( Xword );
-				dword dataType = REGTYPE;
-				scoped_reg_handle regHandle( hk );
+			out += pending;
+			pending.clear();
 
-				r = ::RegQueryValueEx( hk, valueName.c_str(), null, &dataType, reinterpret_cast< byte* >( &result ), &size );
-				if ( r == ERROR_SUCCESS && dataType == REGTYPE && size == sizeof( Xword ) )
-					return result;
-			}
+			std::wstring_view name = TrimIni( line.substr( 0, line.find( L'=' ) ) );
+			auto k = current->keyIndex.find( FoldIniName( name ) );
 
-			exception< std::runtime_error >( REGVALUE_ERROR( "GetRegXword", subKey, valueName, r ) );
+			if ( k == current->keyIndex.end() )
+			{
+				out += raw;
+				continue;
+			}
 
-			return null;
-		}
+			const key_edit& edit = current->keys[k->second];
+			std::vector< bool >::reference done = written[static_cast< std::size_t >( current - m_sections.data() )][k->second];
 
-	}
+			// A removed key goes with all its duplicates. A set one replaces the first, the one readers see.
+			if ( !edit.value )
+				continue;
 
-	dword GetRegDword( hkey_t parentKey, const string_t& subKey, const string_t& valueName )
-	{
-		return GetRegXword< dword, REG_DWORD >( parentKey, subKey, valueName );
-	}
+			if ( done )
+			{
+				out += raw;
+				continue;
+			}
 
-	qword GetRegQword( hkey_t parentKey, const string_t& subKey, const string_t& valueName )
-	{
-		return GetRegXword< qword, REG_QWORD >( parentKey, subKey, valueName );
-	}
+			done = true;
+			out.append( body.substr( 0, body.size() - TrimIni( body ).size() ) )		// the indentation
+				.append( name ).append( 1, L'=' ).append( *edit.value )
+				.append( raw.substr( body.size() ) );
+		}
 
-	string_t GetRegString( hkey_t parentKey, const string_t& subKey, const string_t& valueName )
-	{
-		hkey_t hk;
+		finishSection();
 
-		LSTATUS r = ::RegOpenKeyEx( parentKey, subKey.c_str(), 0, KEY_READ, &hk );
-		if ( r == ERROR_SUCCESS )
+		for ( std::size_t i = 0; i < m_sections.size(); ++i )
 		{
-			dword size = 0;
-			scoped_reg_handle regHandle( hk );
-			r = ::RegQueryValueEx( hk, valueName.c_str(), null, null, null, &size );
-			if ( r == ERROR_SUCCESS )
-			{
-				dword dataType;
-				std::vector< byte > buffer( size );
-				r = ::RegQueryValueEx( hk, valueName.c_str(), null, &dataType, buffer.data(), &size );
-				if ( r == ERROR_SUCCESS )
-				{
-					switch ( dataType )
-					{
-					case REG_DWORD:
-						return strprintf( _T( "%I32u" ), *reinterpret_cast< dword* >( buffer.data() ) );
+			const section_edit& s = m_sections[i];
 
-					case REG_QWORD:
-						return strprintf( _T( "%I64u" ), *reinterpret_cast< qword* >( buffer.data() ) );
-
-					case REG_SZ:
-					case REG_EXPAND_SZ:
-						return { reinterpret_cast< char_t* >( buffer.data() ), ( buffer.size() / sizeof( char_t ) ) - 1 };
+			if ( seen[i] || !hasValues( s ) )
+				continue;
 
-					default:
-						;
-					}
+			newLine();
+			out.append( L"[" ).append( s.name ).append( L"]\r\n" );
 
-					return { buffer.begin(), buffer.end() };
-				}
+			for ( const auto& k : s.keys )
+			{
+				if ( k.value )
+					writeKey( k );
 			}
 		}
 
-		exception< std::runtime_error >( REGVALUE_ERROR( "GetRegString", subKey, valueName, r ) );
-
-		return null;
+		return out;
 	}
 
-	void SetRegString( hkey_t parentKey, const string_t& subKey, const string_t& valueName, const string_t& value )
+	void ini_transaction::commit()
 	{
-		hkey_t hk;
-		dword disposition;
+		std::vector< byte > bytes;
+		IniEncoding encoding = IniEncoding::Ansi;
+		std::wstring text;
 
-		LSTATUS r = ::RegCreateKeyEx( parentKey, subKey.c_str(), 0, null, REG_OPTION_NON_VOLATILE, KEY_WRITE, null, &hk, &disposition );
-		if ( r == ERROR_SUCCESS )
+		// The file is edited as UTF-16 in both builds, so that the characters of a UTF-8 or UTF-16 file
+		// that the ANSI code page lacks survive an ANSI build.
+		if ( ReadIniFile( m_file, bytes ) )
 		{
-			scoped_reg_handle regHandle( hk );
-			r = ::RegSetValueEx( hk, valueName.c_str(), 0, REG_SZ, reinterpret_cast< const byte* >( value.c_str() ), numeric_cast< dword >( value.length() ) );
-			if ( r == ERROR_SUCCESS )
-				return ;
+			text = DecodeIniFile( bytes, encoding );
 		}
+		else
+		{
+			dword error = ::GetLastError();
 
-		exception< std::runtime_error >( REGVALUE_ERROR( "SetRegString", subKey, valueName, r ) );
-	}
+			if ( error != ERROR_FILE_NOT_FOUND )
+				exception< std::runtime_error >( FUNC_ERROR_MSG( "ini_transaction::commit", "Cannot read the file. (0x%08x)", error ) );
+		}
 
-	void SetRegBinary( hkey_t parentKey, const string_t& subKey, const string_t& valueName, uint type, const void* ptr, uint size )
-	{
-		hkey_t hk;
-		dword disposition;
+		std::vector< byte > output = EncodeIniFile( apply( text ), encoding );
 
-		LSTATUS r = ::RegCreateKeyEx( parentKey, subKey.c_str(), 0, null, REG_OPTION_NON_VOLATILE, KEY_WRITE, null, &hk, &disposition );
-		if ( r == ERROR_SUCCESS )
-		{
-			scoped_reg_handle regHandle( hk );
-			r = ::RegSetValueEx( hk, valueName.c_str(), 0, type, reinterpret_cast< const byte* >( ptr ), size );
-			if ( r == ERROR_SUCCESS )
-				return;
-		}
+		// The temporary file is created beside the original, so that renaming it stays on one volume.
+		path_t directory = m_file.parent_path();
 
-		exception< std::runtime_error >( REGVALUE_ERROR( "SetRegBinary", subKey, valueName, r ) );
-	}
+		if ( directory.empty() )
+			directory = _T( "." );
 
-	string_t GetIniString( const path_t& file, const string_t& section, const string_t& name, const string_t& defaultValue )
-	{
-		vchar_t buffer( 512 );
+		string_t dir = to_string_t( directory );
+		details::system_buffer< char_t, MAX_PATH > buffer( std::max< std::size_t >( MAX_PATH, dir.length() + 16 ) );
 
-		adaptive_load( buffer, buffer.size(),
-			[&section, &name, &defaultValue, &file] ( char_t* s, std::size_t n ) 
+		if ( ::GetTempFileName( dir.c_str(), _T( "ini" ), 0, cstr_t( buffer ) ) == 0 )
+			exception< std::runtime_error >( FUNC_ERROR_MSG( "GetTempFileName", "Failed. (0x%08x)", ::GetLastError() ) );
+
+		string_t temp = cstr_t( buffer );
+		bool keepTemp = false;		// set once the new contents may exist only in temp
+
+		try
 		{
-			dword r = ::GetPrivateProfileString( section.c_str()
-												 , name.c_str()
-												 , defaultValue.c_str()
-												 , s
-												 , numeric_cast< dword >( n )
-												 , to_string_t( file ).c_str() );
-			return ( r == n - 1 ) ? r + 1 : r;
-		} );
+			{
+				scoped_generic_handle h( ::CreateFile( temp.c_str(), GENERIC_WRITE, 0, null, TRUNCATE_EXISTING, FILE_ATTRIBUTE_NORMAL, null ) );
 
-		return cstr_t( buffer );
-	}
+				if ( h.get() == nullhandle )
+				{
+					h.release();
+					exception< std::runtime_error >( FUNC_ERROR_MSG( "CreateFile", "Failed. (0x%08x)", ::GetLastError() ) );
+				}
 
-	bool GetIniBinary( const path_t& file, const string_t& section, const string_t& name, void* ptr, uint size )
-	{
-		if ( ptr == null )
-			exception< std::logic_error >( ERROR_MSG( "ptr is null" ) );
+				if ( !WriteAll( h.get(), output.data(), output.size() ) )
+					exception< std::runtime_error >( FUNC_ERROR_MSG( "WriteFile", "Failed. (0x%08x)", ::GetLastError() ) );
 
-		return ( ::GetPrivateProfileStruct( section.c_str(), name.c_str(), ptr, size, to_string_t( file ).c_str() ) != FALSE );
-	}
+				// The data must reach the disk before the file is replaced, or a crash could leave an empty file in place of the original.
+				if ( ::FlushFileBuffers( h.get() ) == FALSE )
+					exception< std::runtime_error >( FUNC_ERROR_MSG( "FlushFileBuffers", "Failed. (0x%08x)", ::GetLastError() ) );
+			}
 
-	void SetIniString( const path_t& file, const string_t& section, const string_t& name, const string_t& value )
-	{
-		LPCTSTR pszName = ( !name.empty() ) ? name.c_str() : null;
-		LPCTSTR pszValue = ( !value.empty() ) ? value.c_str() : null;
+			string_t target = to_string_t( m_file );
 
-		::WritePrivateProfileString( section.c_str(), pszName, pszValue, to_string_t( file ).c_str() );
-	}
+			// ReplaceFile() gives the new file the ACL and attributes of the original, which renaming over it would drop.
+			// Only a file that does not exist yet is renamed into place.
+			if ( ::ReplaceFile( target.c_str(), temp.c_str(), null, REPLACEFILE_IGNORE_MERGE_ERRORS, null, null ) == FALSE )
+			{
+				dword error = ::GetLastError();
 
-	void SetIniBinary( const path_t& file, const string_t& section, const string_t& name, const void* ptr, uint size )
-	{
-		LPCTSTR pszName = ( !name.empty() ) ? name.c_str() : null;
+				switch ( error )
+				{
+				case ERROR_FILE_NOT_FOUND:
+					if ( ::MoveFileEx( temp.c_str(), target.c_str(), MOVEFILE_WRITE_THROUGH ) == FALSE )
+						exception< std::runtime_error >( FUNC_ERROR_MSG( "MoveFileEx", "Failed. (0x%08x)", ::GetLastError() ) );
+					break;
+
+				case ERROR_UNABLE_TO_MOVE_REPLACEMENT:
+				case ERROR_UNABLE_TO_MOVE_REPLACEMENT_2:
+					// ReplaceFile() stopped half way: the original is gone or renamed, and the new contents are only in temp.
+					// So temp is renamed into place the plain way, and is never deleted.
+					keepTemp = true;
+
+					if ( ::MoveFileEx( temp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) == FALSE )
+						exception< std::runtime_error >( FUNC_ERROR_MSG( "MoveFileEx", "Failed. The new contents are left in '%s'. (0x%08x)", temp.c_str(), ::GetLastError() ) );
+					break;
+
+				default:
+					// The target is unchanged.
+					exception< std::runtime_error >( FUNC_ERROR_MSG( "ReplaceFile", "Failed. (0x%08x)", error ) );
+				}
+			}
+		}
+		catch ( ... )
+		{
+			if ( !keepTemp )
+				::DeleteFile( temp.c_str() );
 
-		if ( ptr == null )
-			exception< std::logic_error >( ERROR_MSG( "ptr is null" ) );
+			throw;
+		}
 
-		::WritePrivateProfileStruct( section.c_str(), pszName, const_cast< void* >( ptr ), size, to_string_t( file ).c_str() );
+		rollback();
 	}
 }